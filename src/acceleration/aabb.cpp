@@ -1,19 +1,52 @@
 #include "acceleration.h"
 
 
-bool isHitBounds(Ray ray, glm::vec3 min, glm::vec3 max) {
+bool isHitBounds(const Ray& ray, glm::vec3 min, glm::vec3 max) {
+	float entry;
+	return isHitBounds(ray, min, max, entry);
+}
+
+
+bool isHitBounds(const Ray& ray, glm::vec3 min, glm::vec3 max, float& entry) {
 	/// This is a variation of a classic AABB intersection test
 	/// I used optimization advices described in this article: https://medium.com/@bromanz/another-view-on-the-classic-ray-aabb-intersection-algorithm-for-bvh-traversal-41125138b525
 	
-	glm::vec3 invRayDir = 1.0f / ray.direction;
-	glm::vec3 t0 = (min - ray.origin) * invRayDir;
-	glm::vec3 t1 = (max - ray.origin) * invRayDir;
+	glm::vec3 t0 = (min - ray.origin) * ray.invDirection;
+	glm::vec3 t1 = (max - ray.origin) * ray.invDirection;
 
 	glm::vec3 tmin = glm::min(t0, t1);
-	glm::vec3 tmax = glm::max(t0, t1);
+	glm::vec3 tmax = glm::max(t0, t1) * BOX_ROUNDING;
 
 	float lowest = glm::max(ray.minLen, glm::max(tmin[0], glm::max(tmin[1], tmin[2])));
 	float highest = glm::min(ray.maxLen, glm::min(tmax[0], glm::min(tmax[1], tmax[2])));
 
+	entry = lowest;
 	return lowest <= highest;
-}
\ No newline at end of file
+}
+
+
+float surfaceArea(glm::vec3 min, glm::vec3 max) {
+	glm::vec3 size = max - min;
+	return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+void Bounds::grow(glm::vec3 point) {
+	min = glm::min(min, point);
+	max = glm::max(max, point);
+}
+
+
+void Bounds::grow(const Bounds& other) {
+	min = glm::min(min, other.min);
+	max = glm::max(max, other.max);
+}
+
+
+glm::vec3 Bounds::center() const {
+	return (min + max) / 2.0f;
+}
+
+
+float Bounds::area() const {
+	return surfaceArea(min, max);
+}
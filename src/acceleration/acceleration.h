@@ -1,13 +1,75 @@
 #ifndef accel_h // include guard
 #define accel_h
 
-#include "../raytracer.h"
 #include "../models/model.h"
+#include "../utility/arena.h"
+#include "../utility/array_view.h"
+#include "../utility/scheduler.h"
 #include "acceleration.h"
+#include "traversal.h"
+#include "packet.h"
 
+#include <float.h>	// FLT_MAX
+#include <stdint.h>	// uint32_t
+#include <string>	// std::string
 
 /// Allows to check if the [Ray] intersected a bounding volume
-bool isHitBounds(Ray ray, glm::vec3 min, glm::vec3 max);
+bool isHitBounds(const Ray& ray, glm::vec3 min, glm::vec3 max);
+
+/// Same, but also returns the distance at which the [Ray] enters the volume
+bool isHitBounds(const Ray& ray, glm::vec3 min, glm::vec3 max, float& entry);
+
+float surfaceArea(glm::vec3 min, glm::vec3 max);
+
+
+class Bounds {
+	/// Axis aligned bounding box, empty until something is added
+public:
+	glm::vec3 min = glm::vec3(FLT_MAX);
+	glm::vec3 max = glm::vec3(-FLT_MAX);
+
+	void grow(glm::vec3 point);
+	void grow(const Bounds& other);
+	glm::vec3 center() const;
+	float area() const;
+};
+
+
+/// Builds a binary SAH tree over primitives with the given [bounds], straight into flat [nodes].
+/// [order] receives the primitive indices leaf by leaf, a leaf references a range of it.
+void buildFlatSAH(const std::vector<Bounds>& bounds, int maxLeafSize,
+	std::vector<FlatNode>& nodes, std::vector<uint32_t>& order);
+
+
+enum class HierarchyType { octree, sah, lbvh };
+
+bool parseHierarchyType(const std::string& name, HierarchyType& type);
+const char* hierarchyTypeName(HierarchyType type);
+
+
+class HierarchyStats {
+	/// Describes the quality of a hierarchy using the Surface Area Heuristic (SAH).
+	///
+	/// The chance that a ray which hits the root box also hits a node's box is about
+	/// area(node) / area(root). Summing this over the nodes gives the expected number of
+	/// box & triangle tests per ray. Lower is faster.
+public:
+	int nodes = 0;
+	int leaves = 0;
+	int depth = 0;
+	float boxTests = 0.0f;
+	float triangleTests = 0.0f;
+
+	// Relative cost of a box test & a triangle test
+	static constexpr float traversalCost = 1.0f;
+	static constexpr float intersectionCost = 1.0f;
+
+	float cost() const;
+	void print(const char* name) const;
+};
+
+
+struct HierarchyBuild;
 
 
 class MeshHierarchy : public Object {
@@ -16,14 +78,176 @@ class MeshHierarchy : public Object {
 	/// I use a spatial data structure similar to an "Octree" to separate triangles 
 	/// into smaller groups based on proximity. This allows to group non-empty nodes 
 	/// on different depths to create bounding volumes.
+	///
+	/// Alternatively, the SAH type makes a binary tree where each split is the one with
+	/// the lowest SAH cost. This gives much less overlap for uneven meshes.
+	///
+	/// The LBVH type is binary too and quicker to build: triangles are sorted by the Morton
+	/// code of their barycenter and split where the codes' highest differing bit changes, then
+	/// small treelets are rearranged into the binary tree with the least area. It suits meshes
+	/// that are rebuilt often.
+	///
+	/// The root holds one array of triangle indices, and every node a range of it (only the
+	/// leaves, once LBVH treelets are rearranged). A node is split by partitioning its range in
+	/// place, so children end up next to each other and the leaves, left to right, cover the
+	/// array. With a [Scheduler], big nodes are binned & partitioned in chunks by several tasks,
+	/// and big subtrees are built by tasks of their own.
 public:
 	MeshHierarchy* children[8] = { NULL }; // Using Octree to insert BVH nodes by proximity
-	Mesh* mesh = NULL;
+	Mesh* mesh = NULL;				// the whole mesh, shared by every node
+	ArrayView<uint32_t> triangles;	// indices of the triangles of [mesh] in this node
+	glm::vec3 min;
+	glm::vec3 max;
 
 	bool isLeave = false;
 
-	bool build(Mesh* mesh, int threshold = 4, int maxDepth = 20, int currDepth = 0);
-	bool isHit(Ray ray, Hit & hit) override;
+	// Where the children are allocated, the arena then owns them. Without one they are new'd
+	Arena* arena = NULL;
+
+	~MeshHierarchy();
+
+	// Over every triangle of [mesh], on the threads of [scheduler] if given
+	bool build(Mesh* mesh, HierarchyType type = HierarchyType::octree, Scheduler* scheduler = nullptr);
+
+	HierarchyStats getStats();
+	bool isHit(const Ray& ray, Hit & hit) override;
+
+private:
+	std::vector<uint32_t> triangleStorage; // the ranges of every node, in the root only
+
+	MeshHierarchy* makeChild();
+	void setBounds(HierarchyBuild& build);
+	void buildNode(HierarchyBuild& build, int currDepth);
+	void buildOctree(HierarchyBuild& build, int currDepth);
+	void buildSAH(HierarchyBuild& build, int currDepth);
+	void buildMorton(HierarchyBuild& build, int currDepth);
+	void optimizeTreelets(HierarchyBuild& build, int level);
+	void buildChildren(HierarchyBuild& build, int currDepth);
+	void addStats(HierarchyStats& stats, float rootArea, int currDepth);
+};
+
+
+// A refitted tree is rebuilt once its cost grows past this factor of the cost it was built with
+const float REFIT_MAX_DEGRADATION = 1.5f;
+
+
+class FlatHierarchy : public Object {
+	/// The same tree as a [MeshHierarchy], stored in one contiguous array of nodes.
+	/// The triangles of the mesh are reordered leaf by leaf, so a leaf is a range of them.
+	///
+	/// It is traversed with a small explicit stack instead of recursion. Children are
+	/// visited nearest first, and once a triangle is hit the ray is clipped to it,
+	/// so the boxes further away are skipped without testing their content.
+	///
+	/// Like the triangles of the mesh, the nodes are read through a view: of [nodeStorage]
+	/// once flattened, or of a mapped mesh file.
+	///
+	/// When the vertices of the mesh move (e.g. a deforming mesh over the frames of an animation),
+	/// [update] refits the boxes to them instead of building a new tree. The topology stays, so
+	/// the boxes overlap more and more as the triangles move away from where they were built;
+	/// the SAH cost tells when that has gone too far, and the tree is then rebuilt.
+public:
+	ArrayView<FlatNode> nodes;
+	std::vector<FlatNode> nodeStorage;
+	Mesh* mesh = NULL; // all the triangles
+	HierarchyType type = HierarchyType::octree; // what [update] rebuilds the tree with
+	float builtCost = 0.0f; // [cost] right after the tree was built
+
+	void flatten(MeshHierarchy* root);
+	float cost() const; // SAH cost of the boxes as they are now, the same measure as [HierarchyStats::cost]
+
+	/// Recomputes the box of every node bottom-up, from the packed triangles. False if the
+	/// nodes are mapped from a file, they can't change then.
+	bool refit(Scheduler* scheduler = nullptr);
+
+	/// After the vertices of [mesh] changed (translate, scale, rotate or any edit): packs the
+	/// mesh again and refits the tree, or rebuilds it when the refitted tree costs more than
+	/// [maxDegradation] times its [builtCost]. True if it was rebuilt.
+	bool update(Scheduler* scheduler = nullptr, float maxDegradation = REFIT_MAX_DEGRADATION);
+	void rebuild(Scheduler* scheduler = nullptr);
+	bool isHit(const Ray& ray, Hit & hit) override;
+	void isHit(RayPacket& packet, RayMask mask) override;
+	bool getBounds(glm::vec3& min, glm::vec3& max) override;
+	void printName() override;
+
+private:
+	void flattenNode(MeshHierarchy* node, uint32_t index, std::vector<uint32_t>& order);
+};
+
+
+class SphereArray {
+	/// Spheres as structure-of-arrays, tested in a plain loop instead of through [Object::isHit]
+public:
+	std::vector<float> center[3];	// center[axis][i]
+	std::vector<float> radius;
+	std::vector<Sphere*> objects;	// what a hit refers to, for shading
+
+	void add(Sphere* sphere);
+	bool isHit(uint32_t i, const Ray& ray, Hit& hit) const;
+};
+
+
+class PlaneArray {
+	/// Planes as structure-of-arrays, same idea as [SphereArray]
+public:
+	std::vector<float> point[3];
+	std::vector<float> normal[3];
+	std::vector<Plane*> objects;
+
+	void add(Plane* plane);
+	bool isHit(uint32_t i, const Ray& ray, Hit& hit) const;
+};
+
+
+class MeshInstance {
+	/// A mesh and the tree over its triangles, or a small mesh without one (e.g. a lamp)
+public:
+	Mesh* mesh = NULL;
+	FlatHierarchy* tree = NULL;
+
+	bool isHit(const Ray& ray, Hit& hit) const;
+	void isHit(RayPacket& packet, RayMask mask) const;
+};
+
+
+class SceneLeaf {
+	/// The objects of a leaf of the scene tree, a range in each array of a [SceneHierarchy]
+public:
+	uint32_t spheres = 0;
+	uint32_t sphereCount = 0;
+	uint32_t meshes = 0;
+	uint32_t meshCount = 0;
+	uint32_t others = 0;
+	uint32_t otherCount = 0;
+};
+
+
+class SceneHierarchy {
+	/// Top level of the acceleration: a tree over the boxes of all bounded objects
+	/// (spheres, meshes, lamps), so the cost of a ray grows with the log of the object count.
+	/// Infinite planes have no box, they are kept in a short list that is always tested.
+	///
+	/// The [Object]s are only the loading front end. [build] compiles them into one contiguous
+	/// array per type, so the inner loops call the hit test of each type directly instead of
+	/// going through a virtual call per object. Types without an array of their own are kept
+	/// in [others] and still tested through [Object::isHit].
+public:
+	std::vector<FlatNode> nodes;	// the first of a leaf indexes [leaves]
+	std::vector<SceneLeaf> leaves;
+
+	SphereArray spheres;			// ordered leaf by leaf, like [meshes] & [others]
+	std::vector<MeshInstance> meshes;
+	std::vector<Object*> others;
+
+	PlaneArray planes;				// unbounded
+	std::vector<Object*> unbounded;	// other unbounded objects
+
+	void build(const std::vector<Object*>& objects);
+	void printStats() const;
+
+	// Finds the closest hit, or any hit if ![ray].closest
+	bool isHit(const Ray& ray, Hit & hit);
+	void isHit(RayPacket& packet); // closest hits only
 };
 
 
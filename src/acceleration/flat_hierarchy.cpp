@@ -0,0 +1,213 @@
+#include "acceleration.h"
+
+
+// Trees with fewer nodes are refitted by one thread
+const uint32_t REFIT_CHUNK_MIN = 1 << 15;
+
+
+void FlatHierarchy::flatten(MeshHierarchy* root) {
+	mesh = root->mesh;
+	center = mesh->center;
+
+	std::vector<uint32_t> order;
+	order.reserve(mesh->triangleCount());
+
+	nodeStorage.clear();
+	nodeStorage.push_back(FlatNode());
+	flattenNode(root, 0, order);
+	nodes = nodeStorage;
+
+	// Leaves refer to ranges of triangles from now on
+	mesh->reorder(order);
+	builtCost = cost();
+}
+
+
+void FlatHierarchy::flattenNode(MeshHierarchy* node, uint32_t index, std::vector<uint32_t>& order) {
+	FlatNode flat = FlatNode();
+	flat.min = node->min;
+	flat.max = node->max;
+
+	if (node->isLeave) {
+		flat.isLeaf = 1;
+		flat.first = (uint32_t)order.size();
+		flat.count = (uint32_t)node->triangles.size;
+		order.insert(order.end(), node->triangles.begin(), node->triangles.end());
+		nodeStorage[index] = flat;
+		return;
+	}
+
+	std::vector<MeshHierarchy*> children;
+	for (MeshHierarchy* child : node->children) {
+		if (child) {
+			children.push_back(child);
+		}
+	}
+
+	// Reserving a block for the children first, so they end up next to each other
+	flat.isLeaf = 0;
+	flat.first = (uint32_t)nodeStorage.size();
+	flat.count = (uint32_t)children.size();
+	nodeStorage[index] = flat;
+	nodeStorage.resize(nodeStorage.size() + children.size());
+
+	for (uint32_t i = 0; i < children.size(); i++) {
+		flattenNode(children[i], flat.first + i, order);
+	}
+}
+
+
+float FlatHierarchy::cost() const {
+	// Every box is weighted by the chance that a ray reaching the root also reaches it
+	HierarchyStats stats;
+	stats.boxTests = 1.0f; // the root box is always tested
+	float rootArea = surfaceArea(nodes[0].min, nodes[0].max);
+	for (const FlatNode& node : nodes) {
+		float probability = rootArea > 0.0f ? surfaceArea(node.min, node.max) / rootArea : 1.0f;
+		if (node.isLeaf) {
+			stats.triangleTests += probability * node.count;
+		}
+		else {
+			stats.boxTests += probability * node.count; // every child box is tested
+		}
+	}
+	return stats.cost();
+}
+
+
+bool FlatHierarchy::refit(Scheduler* scheduler) {
+	if (nodeStorage.empty()) {
+		return false; // mapped
+	}
+
+	// Leaves only read their triangles, so they are refitted in chunks by several tasks
+	uint32_t count = (uint32_t)nodeStorage.size();
+	int chunks = scheduler && scheduler->size() > 1 && count >= REFIT_CHUNK_MIN ? 4 * scheduler->size() : 1;
+	auto refitLeaves = [this, count, chunks](int chunk) {
+		for (uint32_t i = (uint32_t)((uint64_t)count * chunk / chunks); i < (uint64_t)count * (chunk + 1) / chunks; i++) {
+			FlatNode& node = nodeStorage[i];
+			if (!node.isLeaf) {
+				continue;
+			}
+			Bounds box;
+			for (uint32_t t = node.first; t < node.first + node.count; t++) {
+				for (int k = 0; k < 3; k++) {
+					box.grow(mesh->packed(t, k));
+				}
+			}
+			node.min = box.min;
+			node.max = box.max;
+		}
+	};
+	TaskGroup group;
+	for (int chunk = 1; chunk < chunks; chunk++) {
+		scheduler->spawn(group, [&refitLeaves, chunk]() { refitLeaves(chunk); });
+	}
+	refitLeaves(0);
+	if (chunks > 1) {
+		scheduler->wait(group);
+	}
+
+	// Children are stored after their parent, so walking backwards meets them first
+	for (uint32_t i = count; i-- > 0;) {
+		FlatNode& node = nodeStorage[i];
+		if (node.isLeaf) {
+			continue;
+		}
+		Bounds box;
+		for (uint32_t c = node.first; c < node.first + node.count; c++) {
+			box.grow(nodeStorage[c].min);
+			box.grow(nodeStorage[c].max);
+		}
+		node.min = box.min;
+		node.max = box.max;
+	}
+	center = (nodeStorage[0].min + nodeStorage[0].max) / 2.0f;
+	return true;
+}
+
+
+bool FlatHierarchy::update(Scheduler* scheduler, float maxDegradation) {
+	if (nodeStorage.empty() || mesh->vertices.empty()) {
+		return false; // mapped from a file, nothing can move
+	}
+	mesh->resetOrigin(); // transforms pivot around the center of the mesh as it is now
+	mesh->pack();
+	refit(scheduler);
+	if (cost() <= builtCost * maxDegradation) {
+		return false;
+	}
+	rebuild(scheduler);
+	return true;
+}
+
+
+void FlatHierarchy::rebuild(Scheduler* scheduler) {
+	// The pointer tree is only needed until it is flattened, so it gets an arena of its own
+	Arena buildArena;
+	MeshHierarchy* root = buildArena.make<MeshHierarchy>();
+	root->arena = &buildArena;
+	root->build(mesh, type, scheduler);
+	flatten(root);
+	center = (nodeStorage[0].min + nodeStorage[0].max) / 2.0f;
+}
+
+
+bool FlatHierarchy::isHit(const Ray& ray, Hit & hit) {
+	bool found = false;
+	Hit curr = Hit();
+
+	Ray clipped = ray; // gets shorter with every closer hit
+
+	traverse(nodes, clipped, [&](const FlatNode& leaf) {
+		if (mesh->isHit(clipped, leaf.first, leaf.first + leaf.count, curr)) {
+			hit = curr;
+			found = true;
+			if (!clipped.closest) {
+				return true;
+			}
+			// Only closer triangles can be hit from now on
+			clipped.maxLen = curr.rayLen;
+		}
+		return false;
+	});
+
+	if (found && ray.closest) {
+		mesh->setNormal(ray, hit);
+	}
+	return found;
+}
+
+
+void FlatHierarchy::isHit(RayPacket& packet, RayMask mask) {
+	RayMask found = 0;
+
+	traversePacket(nodes, packet, mask, [&](const FlatNode& leaf, RayMask rays) {
+		while (rays) {
+			int i = nextRay(rays);
+			Hit curr = Hit();
+			// Only closer triangles can be hit, the ray is clipped to the closest hit so far
+			if (mesh->isHit(packet.rays[i], leaf.first, leaf.first + leaf.count, curr)) {
+				packet.setHit(i, curr);
+				found |= RayMask(1) << i;
+			}
+		}
+	});
+
+	while (found) {
+		int i = nextRay(found);
+		mesh->setNormal(packet.rays[i], packet.hits[i]);
+	}
+}
+
+
+bool FlatHierarchy::getBounds(glm::vec3& min, glm::vec3& max) {
+	min = nodes[0].min;
+	max = nodes[0].max;
+	return true;
+}
+
+
+void FlatHierarchy::printName() {
+	printf("Mesh");
+}
@@ -1,73 +1,273 @@
 #include "acceleration.h"
 
+#include <algorithm>	// std::partition_point, std::find
+#include <float.h>	// FLT_MAX
+#include <mutex>	// std::mutex
+#include <string.h>	// memcpy
 
-bool MeshHierarchy::build(Mesh* newMesh, int threshold, int maxDepth, int currDepth) {
 
-	mesh = newMesh;
+// Nodes with fewer triangles are split by one thread. Bigger ones are binned & partitioned
+// in chunks, by as many tasks.
+const uint32_t PARALLEL_SPLIT_MIN = 1 << 16;
+const uint32_t CHUNK_MIN = 1 << 14;
+const int MAX_CHUNKS = 64;
 
-	// Mesh contains a minimum number of objects, this is a base case.
-	if (mesh->triangles.size() <= threshold || currDepth >= maxDepth) {
-		//printf("Leave node has this number of triangles = %d\n", mesh->triangles.size());
-		isLeave = true;
-		return true;
+// Subtrees with at least this many triangles are built by a task of their own
+const uint32_t SUBTREE_TASK_MIN = 1 << 12;
+
+// LBVH treelets: few enough leaves to try every binary tree over them. Karras & Aila use 7,
+// 5 gets most of the gain for a ninth of the work. The treelets of the first levels are
+// restructured by tasks of their own.
+const int TREELET_LEAVES = 5;
+const int TREELET_PASSES = 2;
+const int TREELET_TASK_LEVELS = 2;
+
+
+struct HierarchyBuild {
+	/// Shared by the nodes of a tree while it is built
+	Mesh* mesh = nullptr;
+	Scheduler* scheduler = nullptr;		// null to build on the calling thread
+	HierarchyType type = HierarchyType::octree;
+	int threshold = 4;
+	int maxDepth = 20;
+
+	uint32_t* indices = nullptr;		// the root's triangles, partitioned in place
+	std::vector<uint32_t> scratch;		// a range is partitioned into the same range here, then copied back
+	std::vector<Bounds> bounds;			// of every triangle
+	std::vector<glm::vec3> centers;		// barycenter of every triangle
+	std::vector<uint64_t> codes;		// LBVH only: Morton code of each triangle of [indices], sorted
+	std::mutex arenaMutex;				// children are made by several tasks at once
+
+	int chunkCount(uint32_t count) const {
+		if (scheduler == nullptr || count < PARALLEL_SPLIT_MIN) {
+			return 1;
+		}
+		return (int)std::min<uint32_t>(std::min(MAX_CHUNKS, 4 * scheduler->size()), count / CHUNK_MIN);
 	}
 
-	// Else, classify each triangle to 1 of the 8 nodes
-	int nodePointsNum[8] = { 0 };
-	
-	for (Triangle* triangle : mesh->triangles) {
-		triangle->nodeID = 0;
-		if (triangle->center.x > mesh->center.x) {
-			triangle->nodeID += 1;
+	// Runs [body](chunk, begin, end) over [0, count) cut into [chunks], as tasks when there are several
+	template <typename Body>
+	void forChunks(uint32_t count, int chunks, Body body) {
+		auto begin = [count, chunks](int chunk) { return (uint32_t)((uint64_t)count * chunk / chunks); };
+		if (chunks == 1) {
+			body(0, 0u, count);
+			return;
 		}
-		if (triangle->center.y > mesh->center.y) {
-			triangle->nodeID += 2;
+		TaskGroup group;
+		for (int chunk = 1; chunk < chunks; chunk++) {
+			scheduler->spawn(group, [&body, &begin, chunk]() { body(chunk, begin(chunk), begin(chunk + 1)); });
 		}
-		if (triangle->center.z > mesh->center.z) {
-			triangle->nodeID += 4;
+		body(0, 0u, begin(1));
+		scheduler->wait(group);
+	}
+
+	// Stable partition of [triangles] into [parts] groups, by [side](triangle). [offsets][chunk][part]
+	// is where the first triangle of [part] found by [chunk] goes, counted by the same chunks.
+	template <typename Side>
+	void partition(uint32_t* triangles, uint32_t count, int chunks, uint32_t offsets[][8], Side side) {
+		uint32_t* out = scratch.data() + (triangles - indices);
+		forChunks(count, chunks, [&](int chunk, uint32_t begin, uint32_t end) {
+			uint32_t next[8];
+			memcpy(next, offsets[chunk], sizeof(next));
+			for (uint32_t i = begin; i < end; i++) {
+				out[next[side(triangles[i])]++] = triangles[i];
+			}
+		});
+		forChunks(count, chunks, [&](int chunk, uint32_t begin, uint32_t end) {
+			memcpy(triangles + begin, out + begin, (end - begin) * sizeof(uint32_t));
+		});
+	}
+};
+
+
+static void sortByMortonCode(HierarchyBuild& build, uint32_t count);
+
+
+// Turns the per chunk [counts] of each part into the offsets of [partition]: parts one after
+// the other, and the chunks in order within a part. [sizes] gets the size of each part.
+static void chunkOffsets(const uint32_t counts[][8], int chunks, int parts, uint32_t offsets[][8], uint32_t* sizes) {
+	uint32_t next = 0;
+	for (int part = 0; part < parts; part++) {
+		sizes[part] = 0;
+		for (int chunk = 0; chunk < chunks; chunk++) {
+			offsets[chunk][part] = next;
+			next += counts[chunk][part];
+			sizes[part] += counts[chunk][part];
 		}
+	}
+}
 
-		// Remember which nodes have triangles. This allows to ignore empty nodes
-		nodePointsNum[triangle->nodeID]++;
+
+void MeshHierarchy::setBounds(HierarchyBuild& build) {
+	// Same as [Mesh::resetOrigin], over the triangles of this node
+	Bounds parts[MAX_CHUNKS];
+	int chunks = build.chunkCount((uint32_t)triangles.size);
+	build.forChunks((uint32_t)triangles.size, chunks, [&](int chunk, uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; i++) {
+			parts[chunk].grow(build.bounds[triangles[i]]);
+		}
+	});
+	Bounds box;
+	for (int chunk = 0; chunk < chunks; chunk++) {
+		box.grow(parts[chunk]);
 	}
+	min = box.min;
+	max = box.max;
+	center = (min + max) / 2.0f;
+}
 
-	for (int i = 0; i < 8; i++) {
-		if (nodePointsNum[i] != 0) {
-			//printf("Node %d, number of triangles = %d\n", i, nodePointsNum[i]);
 
-			children[i] = new MeshHierarchy();
+bool MeshHierarchy::build(Mesh* newMesh, HierarchyType type, Scheduler* scheduler) {
+	HierarchyBuild build;
+	build.mesh = newMesh;
+	build.scheduler = scheduler && scheduler->size() > 1 ? scheduler : nullptr;
+	build.type = type;
+	// Leaves as wide as the triangle kernel, so a leaf is tested in one pass
+	build.threshold = std::max(4, triangleLanes(triangleKernel()));
+	build.maxDepth = type == HierarchyType::octree ? 20 : type == HierarchyType::sah ? 40 : 64;
 
-			std::vector<Triangle*> subset;
+	uint32_t count = newMesh->triangleCount();
+	if (count == 0) {
+		return false;
+	}
 
-			for (Triangle* triangle : mesh->triangles) {
-				if (triangle->nodeID == i) {
-					subset.push_back(triangle);
-				}
+	// What the splits look at, read once per triangle instead of through the indices at every level
+	triangleStorage.resize(count);
+	build.scratch.resize(count);
+	build.bounds.resize(count);
+	build.centers.resize(count);
+	build.forChunks(count, build.chunkCount(count), [&](int chunk, uint32_t begin, uint32_t end) {
+		for (uint32_t t = begin; t < end; t++) {
+			triangleStorage[t] = t;
+			Bounds box;
+			for (int k = 0; k < 3; k++) {
+				box.grow(newMesh->corner(t, k));
 			}
+			build.bounds[t] = box;
+			build.centers[t] = newMesh->barycenter(t);
+		}
+	});
 
-			Mesh* subMesh = new Mesh();
-			subMesh->triangles = subset;
-			subMesh->resetOrigin();
-			children[i]->build(subMesh, threshold, maxDepth, currDepth + 1);
+	build.indices = triangleStorage.data();
+	triangles = ArrayView<uint32_t>(build.indices, count);
+	if (type == HierarchyType::lbvh) {
+		sortByMortonCode(build, count);
+	}
+	buildNode(build, 0);
+
+	if (type == HierarchyType::lbvh) {
+		for (int pass = 0; pass < TREELET_PASSES; pass++) {
+			optimizeTreelets(build, 0);
 		}
 	}
 	return true;
 }
 
 
-bool MeshHierarchy::isHit(Ray ray, Hit & hit) {
-
-	if (!isHitBounds(ray, mesh->min, mesh->max)) {		
-		return false;
+void MeshHierarchy::buildNode(HierarchyBuild& build, int currDepth) {
+	if (build.type == HierarchyType::sah) {
+		buildSAH(build, currDepth);
+	}
+	else if (build.type == HierarchyType::lbvh) {
+		buildMorton(build, currDepth);
 	}
+	else {
+		buildOctree(build, currDepth);
+	}
+}
 
-	if (isLeave) { // Checking each triangle on a small mesh	
-		if (mesh->isHit(ray, hit)) {			
-			return true;
+
+void MeshHierarchy::buildChildren(HierarchyBuild& build, int currDepth) {
+	TaskGroup group;
+	for (MeshHierarchy* child : children) {
+		if (child == NULL) {
+			continue;
+		}
+		if (build.scheduler && child->triangles.size >= SUBTREE_TASK_MIN) {
+			build.scheduler->spawn(group, [child, &build, currDepth]() { child->buildNode(build, currDepth); });
 		}
 		else {
-			return false;
+			child->buildNode(build, currDepth);
+		}
+	}
+	if (build.scheduler) {
+		build.scheduler->wait(group);
+	}
+}
+
+
+void MeshHierarchy::buildOctree(HierarchyBuild& build, int currDepth) {
+
+	mesh = build.mesh;
+	setBounds(build);
+
+	uint32_t count = (uint32_t)triangles.size;
+
+	// Mesh contains a minimum number of objects, this is a base case.
+	if (count <= (uint32_t)build.threshold || currDepth >= build.maxDepth) {
+		isLeave = true;
+		return;
+	}
+
+	// Else, classify each triangle to 1 of the 8 nodes
+	glm::vec3 middle = center;
+	auto nodeID = [&](uint32_t triangle) {
+		glm::vec3 barycenter = build.centers[triangle];
+		return (barycenter.x > middle.x ? 1 : 0) + (barycenter.y > middle.y ? 2 : 0) + (barycenter.z > middle.z ? 4 : 0);
+	};
+
+	uint32_t* range = build.indices + (triangles.data - build.indices);
+	int chunks = build.chunkCount(count);
+	uint32_t counts[MAX_CHUNKS][8] = {};
+	build.forChunks(count, chunks, [&](int chunk, uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; i++) {
+			counts[chunk][nodeID(range[i])]++;
+		}
+	});
+
+	// Children are placed in order, which keeps the order of the triangles within each of them
+	uint32_t offsets[MAX_CHUNKS][8];
+	uint32_t sizes[8];
+	chunkOffsets(counts, chunks, 8, offsets, sizes);
+	build.partition(range, count, chunks, offsets, nodeID);
+
+	uint32_t first = 0;
+	for (int i = 0; i < 8; i++) {
+		if (sizes[i] != 0) { // empty nodes are ignored
+			{
+				std::lock_guard<std::mutex> lock(build.arenaMutex);
+				children[i] = makeChild();
+			}
+			children[i]->triangles = ArrayView<uint32_t>(range + first, sizes[i]);
+			first += sizes[i];
+		}
+	}
+	buildChildren(build, currDepth + 1);
+}
+
+
+bool MeshHierarchy::isHit(const Ray& ray, Hit & hit) {
+
+	if (!isHitBounds(ray, min, max)) {		
+		return false;
+	}
+
+	if (isLeave) { // Checking each triangle on a small group
+		bool found = false;
+		for (uint32_t triangle : triangles) {
+			Hit curr = Hit();
+			if (mesh->hitTriangle(triangle, ray, ray.maxLen, curr)) {
+				if (!ray.closest) {
+					return true;
+				}
+				if (curr.rayLen < hit.rayLen) {
+					mesh->setNormal(ray, curr);
+					hit = curr;
+					found = true;
+				}
+			}
 		}
+		return found;
 	}
 	else { // Checking the next round of Bounding Volumes	
 
@@ -103,3 +303,523 @@ bool MeshHierarchy::isHit(Ray ray, Hit & hit) {
 	return false;
 }
 
+
+
+MeshHierarchy* MeshHierarchy::makeChild() {
+	MeshHierarchy* child = arena ? arena->make<MeshHierarchy>() : new MeshHierarchy();
+	child->arena = arena;
+	return child;
+}
+
+
+MeshHierarchy::~MeshHierarchy() {
+	if (arena) {
+		return; // the arena destroys the children
+	}
+	for (MeshHierarchy* child : children) {
+		delete child;
+	}
+}
+
+
+
+
+/// Surface Area Heuristic
+
+// Triangles are sorted into this many buckets along an axis, then each border between
+// two buckets is evaluated as a possible split
+const int SAH_BINS = 12;
+
+struct Bin {
+	glm::vec3 min = glm::vec3(FLT_MAX);
+	glm::vec3 max = glm::vec3(-FLT_MAX);
+	int count = 0;
+};
+
+
+void MeshHierarchy::buildSAH(HierarchyBuild& build, int currDepth) {
+
+	mesh = build.mesh;
+	setBounds(build);
+
+	int count = (int)triangles.size;
+
+	if (count <= build.threshold || currDepth >= build.maxDepth) {
+		isLeave = true;
+		return;
+	}
+
+	// A leaf costs one triangle test per pass of the kernel, not per triangle
+	int lanes = triangleLanes(triangleKernel());
+	auto passes = [lanes](int triangles) { return (float)((triangles + lanes - 1) / lanes); };
+
+	uint32_t* range = build.indices + (triangles.data - build.indices);
+	int chunks = build.chunkCount((uint32_t)count);
+
+	// Splits are placed between triangle centers
+	Bounds centerParts[MAX_CHUNKS];
+	build.forChunks((uint32_t)count, chunks, [&](int chunk, uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; i++) {
+			centerParts[chunk].grow(build.centers[range[i]]);
+		}
+	});
+	Bounds centerBounds;
+	for (int chunk = 0; chunk < chunks; chunk++) {
+		centerBounds.grow(centerParts[chunk]);
+	}
+	glm::vec3 centerMin = centerBounds.min;
+	glm::vec3 centerMax = centerBounds.max;
+	glm::vec3 extents = centerMax - centerMin;
+
+	auto binOf = [&](uint32_t triangle, int axis) {
+		return std::min(SAH_BINS - 1, int(SAH_BINS * (build.centers[triangle][axis] - centerMin[axis]) / extents[axis]));
+	};
+
+	// The 3 axes are binned in the same pass, each chunk into bins of its own
+	Bin localBins[3][SAH_BINS];
+	std::vector<Bin> chunkBins(chunks > 1 ? chunks * 3 * SAH_BINS : 0);
+	auto binsOf = [&](int chunk) { return chunks > 1 ? &chunkBins[chunk * 3 * SAH_BINS] : &localBins[0][0]; };
+
+	build.forChunks((uint32_t)count, chunks, [&](int chunk, uint32_t begin, uint32_t end) {
+		Bin* bins = binsOf(chunk);
+		for (uint32_t i = begin; i < end; i++) {
+			uint32_t triangle = range[i];
+			const Bounds& box = build.bounds[triangle];
+			for (int axis = 0; axis < 3; axis++) {
+				if (extents[axis] <= 0.0f) {
+					continue; // every center is on the same plane
+				}
+				Bin& bin = bins[axis * SAH_BINS + binOf(triangle, axis)];
+				bin.min = glm::min(bin.min, box.min);
+				bin.max = glm::max(bin.max, box.max);
+				bin.count++;
+			}
+		}
+	});
+
+	float bestCost = FLT_MAX;
+	int bestAxis = -1;
+	int bestBin = 0;
+
+	for (int axis = 0; axis < 3; axis++) {
+		if (extents[axis] <= 0.0f) {
+			continue;
+		}
+
+		Bin bins[SAH_BINS];
+		for (int chunk = 0; chunk < chunks; chunk++) {
+			const Bin* part = binsOf(chunk) + axis * SAH_BINS;
+			for (int b = 0; b < SAH_BINS; b++) {
+				bins[b].min = glm::min(bins[b].min, part[b].min);
+				bins[b].max = glm::max(bins[b].max, part[b].max);
+				bins[b].count += part[b].count;
+			}
+		}
+
+		// Sweep from the right to know the area & count on the right side of each border
+		float rightArea[SAH_BINS];
+		int rightCount[SAH_BINS];
+		Bin right;
+		for (int b = SAH_BINS - 1; b > 0; b--) {
+			right.min = glm::min(right.min, bins[b].min);
+			right.max = glm::max(right.max, bins[b].max);
+			right.count += bins[b].count;
+			rightArea[b] = right.count > 0 ? surfaceArea(right.min, right.max) : 0.0f;
+			rightCount[b] = right.count;
+		}
+
+		Bin left;
+		for (int b = 0; b < SAH_BINS - 1; b++) {
+			left.min = glm::min(left.min, bins[b].min);
+			left.max = glm::max(left.max, bins[b].max);
+			left.count += bins[b].count;
+			if (left.count == 0 || rightCount[b + 1] == 0) {
+				continue;
+			}
+			float cost = surfaceArea(left.min, left.max) * passes(left.count) + rightArea[b + 1] * passes(rightCount[b + 1]);
+			if (cost < bestCost) {
+				bestCost = cost;
+				bestAxis = axis;
+				bestBin = b;
+			}
+		}
+	}
+
+	// Stop when splitting is no cheaper than testing every triangle here
+	float area = surfaceArea(min, max);
+	float leafCost = passes(count) * HierarchyStats::intersectionCost;
+	float splitCost = HierarchyStats::traversalCost * 2 + HierarchyStats::intersectionCost * bestCost / area;
+
+	if (bestAxis < 0 || (splitCost >= leafCost && count <= build.threshold * 4)) {
+		isLeave = true;
+		return;
+	}
+
+	auto side = [&](uint32_t triangle) { return binOf(triangle, bestAxis) <= bestBin ? 0 : 1; };
+	uint32_t counts[MAX_CHUNKS][8] = {};
+	build.forChunks((uint32_t)count, chunks, [&](int chunk, uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; i++) {
+			counts[chunk][side(range[i])]++;
+		}
+	});
+	uint32_t offsets[MAX_CHUNKS][8];
+	uint32_t sizes[8];
+	chunkOffsets(counts, chunks, 2, offsets, sizes);
+	build.partition(range, (uint32_t)count, chunks, offsets, side);
+
+	{
+		std::lock_guard<std::mutex> lock(build.arenaMutex);
+		children[0] = makeChild();
+		children[1] = makeChild();
+	}
+	children[0]->triangles = ArrayView<uint32_t>(range, sizes[0]);
+	children[1]->triangles = ArrayView<uint32_t>(range + sizes[0], sizes[1]);
+	buildChildren(build, currDepth + 1);
+}
+
+
+
+/// Linear BVH
+
+// Spreads the low 21 bits of [v] 3 bits apart, so the bits of 3 axes can be interleaved
+static uint64_t spreadBits(uint64_t v) {
+	v &= 0x1fffff;
+	v = (v | v << 32) & 0x1f00000000ffffull;
+	v = (v | v << 16) & 0x1f0000ff0000ffull;
+	v = (v | v << 8) & 0x100f00f00f00f00full;
+	v = (v | v << 4) & 0x10c30c30c30c30c3ull;
+	v = (v | v << 2) & 0x1249249249249249ull;
+	return v;
+}
+
+
+// Sorts the triangles of [build] along a Z-order curve through their barycenters, so the
+// triangles of any subtree end up next to each other. Codes have 30 bits (10 per axis), or 63
+// for huge meshes where 1024 steps per axis would leave many triangles with the same code.
+static void sortByMortonCode(HierarchyBuild& build, uint32_t count) {
+	int chunks = build.chunkCount(count);
+
+	Bounds parts[MAX_CHUNKS];
+	build.forChunks(count, chunks, [&](int chunk, uint32_t begin, uint32_t end) {
+		for (uint32_t t = begin; t < end; t++) {
+			parts[chunk].grow(build.centers[t]);
+		}
+	});
+	Bounds centerBounds;
+	for (int chunk = 0; chunk < chunks; chunk++) {
+		centerBounds.grow(parts[chunk]);
+	}
+
+	int axisBits = count > (1u << 24) ? 21 : 10;
+	float steps = (float)((1 << axisBits) - 1);
+	glm::vec3 extents = centerBounds.max - centerBounds.min;
+	glm::vec3 scale;
+	for (int axis = 0; axis < 3; axis++) {
+		scale[axis] = extents[axis] > 0.0f ? steps / extents[axis] : 0.0f;
+	}
+
+	build.codes.resize(count);
+	build.forChunks(count, chunks, [&](int chunk, uint32_t begin, uint32_t end) {
+		for (uint32_t t = begin; t < end; t++) {
+			glm::vec3 cell = glm::min((build.centers[t] - centerBounds.min) * scale, glm::vec3(steps));
+			build.codes[t] = spreadBits((uint64_t)cell.x) << 2 | spreadBits((uint64_t)cell.y) << 1 | spreadBits((uint64_t)cell.z);
+		}
+	});
+
+	// Radix sort, 8 bits per pass. Each chunk counts its digits, then moves its triangles to the
+	// same offsets whatever the number of chunks: the sort is stable, so equal codes keep the
+	// order of their triangles and the tree doesn't depend on the number of threads.
+	const int RADIX = 256;
+	std::vector<uint64_t> codeScratch(count);
+	std::vector<uint32_t> counts(chunks * RADIX);
+	uint32_t* indices = build.indices;
+	uint32_t* indexScratch = build.scratch.data();
+	uint64_t* codes = build.codes.data();
+	uint64_t* codesOut = codeScratch.data();
+
+	for (int shift = 0; shift < 3 * axisBits; shift += 8) {
+		std::fill(counts.begin(), counts.end(), 0);
+		build.forChunks(count, chunks, [&](int chunk, uint32_t begin, uint32_t end) {
+			uint32_t* digits = &counts[chunk * RADIX];
+			for (uint32_t i = begin; i < end; i++) {
+				digits[(codes[i] >> shift) & (RADIX - 1)]++;
+			}
+		});
+
+		// Nothing moves when every code has the same digit, e.g. the top bits of a flat mesh
+		bool same = false;
+		for (int digit = 0; digit < RADIX && !same; digit++) {
+			uint32_t total = 0;
+			for (int chunk = 0; chunk < chunks; chunk++) {
+				total += counts[chunk * RADIX + digit];
+			}
+			same = total == count;
+		}
+		if (same) {
+			continue;
+		}
+
+		uint32_t next = 0;
+		for (int digit = 0; digit < RADIX; digit++) {
+			for (int chunk = 0; chunk < chunks; chunk++) {
+				uint32_t n = counts[chunk * RADIX + digit];
+				counts[chunk * RADIX + digit] = next;
+				next += n;
+			}
+		}
+
+		build.forChunks(count, chunks, [&](int chunk, uint32_t begin, uint32_t end) {
+			uint32_t* offsets = &counts[chunk * RADIX];
+			for (uint32_t i = begin; i < end; i++) {
+				uint32_t to = offsets[(codes[i] >> shift) & (RADIX - 1)]++;
+				codesOut[to] = codes[i];
+				indexScratch[to] = indices[i];
+			}
+		});
+		std::swap(codes, codesOut);
+		std::swap(indices, indexScratch);
+	}
+
+	// An odd number of passes leaves the result in the scratch arrays
+	if (indices != build.indices) {
+		memcpy(build.indices, indices, count * sizeof(uint32_t));
+	}
+	if (codes != build.codes.data()) {
+		build.codes.swap(codeScratch);
+	}
+}
+
+
+void MeshHierarchy::buildMorton(HierarchyBuild& build, int currDepth) {
+
+	mesh = build.mesh;
+	uint32_t count = (uint32_t)triangles.size;
+
+	if (count <= (uint32_t)build.threshold || currDepth >= build.maxDepth) {
+		setBounds(build);
+		isLeave = true;
+		return;
+	}
+
+	// The triangles are sorted by code, so the ones with the highest differing bit set
+	// are the end of the range. Identical codes are cut in the middle.
+	const uint64_t* codes = build.codes.data() + (triangles.data - build.indices);
+	uint64_t different = codes[0] ^ codes[count - 1];
+	uint32_t split = count / 2;
+	if (different != 0) {
+		uint64_t bit = 1ull << 63;
+		while ((different & bit) == 0) {
+			bit >>= 1;
+		}
+		split = (uint32_t)(std::partition_point(codes, codes + count, [bit](uint64_t code) { return (code & bit) == 0; }) - codes);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(build.arenaMutex);
+		children[0] = makeChild();
+		children[1] = makeChild();
+	}
+	children[0]->triangles = ArrayView<uint32_t>(triangles.data, split);
+	children[1]->triangles = ArrayView<uint32_t>(triangles.data + split, count - split);
+	buildChildren(build, currDepth + 1);
+
+	// Bottom up, the children know their bounds already
+	min = glm::min(children[0]->min, children[1]->min);
+	max = glm::max(children[0]->max, children[1]->max);
+	center = (min + max) / 2.0f;
+}
+
+
+// The best binary tree over a treelet's leaves: the one whose inner nodes have the smallest
+// total area. The leaves keep their subtrees, so their cost doesn't change.
+struct Treelet {
+	MeshHierarchy* leaves[TREELET_LEAVES];
+	MeshHierarchy* inner[TREELET_LEAVES - 1];	// nodes to reuse, the root first
+	int leafCount = 0;
+	int innerCount = 0;
+
+	Bounds boxes[1 << TREELET_LEAVES];	// of every subset of the leaves
+	float costs[1 << TREELET_LEAVES];
+	int splits[1 << TREELET_LEAVES];
+
+	float current(MeshHierarchy* node) const {
+		if (node->isLeave || std::find(leaves, leaves + leafCount, node) != leaves + leafCount) {
+			return 0.0f;
+		}
+		return surfaceArea(node->min, node->max) + current(node->children[0]) + current(node->children[1]);
+	}
+
+	void optimize() {
+		int all = (1 << leafCount) - 1;
+		for (int set = 1; set <= all; set++) {
+			int low = set & -set;
+			int leaf = 0;
+			while ((1 << leaf) != low) {
+				leaf++;
+			}
+			boxes[set] = boxes[set ^ low];
+			boxes[set].grow(leaves[leaf]->min);
+			boxes[set].grow(leaves[leaf]->max);
+
+			costs[set] = 0.0f;
+			if (set == low) {
+				continue;
+			}
+			// Every split in two, once: the part with the lowest leaf is [part]
+			costs[set] = FLT_MAX;
+			for (int part = (set - 1) & set; part != 0; part = (part - 1) & set) {
+				if ((part & low) == 0) {
+					continue;
+				}
+				float cost = costs[part] + costs[set ^ part];
+				if (cost < costs[set]) {
+					costs[set] = cost;
+					splits[set] = part;
+				}
+			}
+			costs[set] += surfaceArea(boxes[set].min, boxes[set].max);
+		}
+	}
+
+	MeshHierarchy* emit(int set, int& nextInner) {
+		if ((set & (set - 1)) == 0) {
+			int leaf = 0;
+			while ((1 << leaf) != set) {
+				leaf++;
+			}
+			return leaves[leaf];
+		}
+		MeshHierarchy* node = inner[nextInner++];
+		node->children[0] = emit(splits[set], nextInner);
+		node->children[1] = emit(set ^ splits[set], nextInner);
+		node->min = boxes[set].min;
+		node->max = boxes[set].max;
+		node->center = (node->min + node->max) / 2.0f;
+		return node;
+	}
+};
+
+
+void MeshHierarchy::optimizeTreelets(HierarchyBuild& build, int level) {
+	if (isLeave) {
+		return;
+	}
+
+	// Grows the treelet from this node by opening its biggest leaf, until it has enough leaves
+	Treelet treelet;
+	treelet.inner[treelet.innerCount++] = this;
+	treelet.leaves[treelet.leafCount++] = children[0];
+	treelet.leaves[treelet.leafCount++] = children[1];
+	while (treelet.leafCount < TREELET_LEAVES) {
+		int biggest = -1;
+		float biggestArea = -1.0f;
+		for (int i = 0; i < treelet.leafCount; i++) {
+			MeshHierarchy* leaf = treelet.leaves[i];
+			float area = surfaceArea(leaf->min, leaf->max);
+			if (!leaf->isLeave && area > biggestArea) {
+				biggest = i;
+				biggestArea = area;
+			}
+		}
+		if (biggest < 0) {
+			break;
+		}
+		MeshHierarchy* opened = treelet.leaves[biggest];
+		treelet.inner[treelet.innerCount++] = opened;
+		treelet.leaves[biggest] = opened->children[0];
+		treelet.leaves[treelet.leafCount++] = opened->children[1];
+	}
+
+	if (treelet.innerCount > 1) {
+		float current = treelet.current(this);
+		treelet.optimize();
+		if (treelet.costs[(1 << treelet.leafCount) - 1] < current) {
+			int nextInner = 0;
+			treelet.emit((1 << treelet.leafCount) - 1, nextInner);
+			// The triangles of the new inner nodes aren't a range anymore, only leaves need theirs
+			for (int i = 1; i < treelet.innerCount; i++) {
+				treelet.inner[i]->triangles = ArrayView<uint32_t>();
+			}
+		}
+	}
+
+	TaskGroup group;
+	bool tasks = build.scheduler && level < TREELET_TASK_LEVELS;
+	for (int i = 0; i < treelet.leafCount; i++) {
+		MeshHierarchy* leaf = treelet.leaves[i];
+		if (tasks) {
+			build.scheduler->spawn(group, [leaf, &build, level]() { leaf->optimizeTreelets(build, level + 1); });
+		}
+		else {
+			leaf->optimizeTreelets(build, level + 1);
+		}
+	}
+	if (tasks) {
+		build.scheduler->wait(group);
+	}
+}
+
+
+/// Statistics
+
+float HierarchyStats::cost() const {
+	return traversalCost * boxTests + intersectionCost * triangleTests;
+}
+
+
+void HierarchyStats::print(const char* name) const {
+	printf("%s: %d nodes, %d leaves, depth %d, per ray ~ %.1f box tests + %.1f triangle tests, SAH cost = %.1f\n",
+		name, nodes, leaves, depth, boxTests, triangleTests, cost());
+}
+
+
+HierarchyStats MeshHierarchy::getStats() {
+	HierarchyStats stats = HierarchyStats();
+	stats.boxTests = 1.0f; // the root box is always tested
+	addStats(stats, surfaceArea(min, max), 0);
+	return stats;
+}
+
+
+void MeshHierarchy::addStats(HierarchyStats& stats, float rootArea, int currDepth) {
+	// Chance that a ray reaching the root also reaches this node
+	float probability = rootArea > 0.0f ? surfaceArea(min, max) / rootArea : 1.0f;
+
+	stats.nodes++;
+	stats.depth = std::max(stats.depth, currDepth);
+
+	if (isLeave) {
+		stats.leaves++;
+		stats.triangleTests += probability * triangles.size;
+		return;
+	}
+
+	for (MeshHierarchy* child : children) {
+		if (child) {
+			stats.boxTests += probability; // every child box is tested when this node is visited
+			child->addStats(stats, rootArea, currDepth + 1);
+		}
+	}
+}
+
+
+bool parseHierarchyType(const std::string& name, HierarchyType& type) {
+	if (name == "octree") {
+		type = HierarchyType::octree;
+	}
+	else if (name == "sah") {
+		type = HierarchyType::sah;
+	}
+	else if (name == "lbvh") {
+		type = HierarchyType::lbvh;
+	}
+	else {
+		return false;
+	}
+	return true;
+}
+
+
+const char* hierarchyTypeName(HierarchyType type) {
+	return type == HierarchyType::sah ? "sah" : type == HierarchyType::lbvh ? "lbvh" : "octree";
+}
@@ -0,0 +1,172 @@
+#include "packet.h"
+
+#include <float.h>	// FLT_MAX
+#include <math.h>	// isinf
+#include <string.h>	// memset
+
+// SSE2 is part of every x86-64 CPU, so no check is needed at runtime
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PACKET_SSE
+#include <emmintrin.h>
+#endif
+
+
+void RayPacket::clear() {
+	count = 0;
+	coherent = false;
+}
+
+
+void RayPacket::add(const Ray& ray) {
+	rays[count] = ray;
+	hits[count] = Hit();
+	addedLen[count] = ray.maxLen;
+	count++;
+}
+
+
+void RayPacket::close() {
+	// Unused lanes are still loaded by the SIMD tests, their results are masked out
+	memset(invDirection, 0, sizeof(invDirection));
+	memset(maxLen, 0, sizeof(maxLen));
+
+	for (int i = 0; i < count; i++) {
+		for (int axis = 0; axis < 3; axis++) {
+			invDirection[axis][i] = rays[i].invDirection[axis];
+		}
+		maxLen[i] = rays[i].maxLen;
+	}
+
+	// The frustum is only tight when every ray enters a box through the same sides,
+	// and an infinite inverse direction (a ray parallel to an axis) would give NaN bounds
+	coherent = count > 0;
+	invMin = rays[0].invDirection;
+	invMax = invMin;
+	for (int i = 0; i < count && coherent; i++) {
+		for (int axis = 0; axis < 3; axis++) {
+			coherent = coherent && rays[i].sign[axis] == rays[0].sign[axis] && !isinf(rays[i].invDirection[axis]);
+		}
+		invMin = glm::min(invMin, rays[i].invDirection);
+		invMax = glm::max(invMax, rays[i].invDirection);
+	}
+}
+
+
+Ray RayPacket::added(int i) const {
+	Ray ray = rays[i];
+	ray.maxLen = addedLen[i];
+	return ray;
+}
+
+
+RayMask RayPacket::all() const {
+	return count == PACKET_RAYS ? ~RayMask(0) : (RayMask(1) << count) - 1;
+}
+
+
+void RayPacket::clip(int i, float len) {
+	rays[i].maxLen = len;
+	maxLen[i] = len;
+}
+
+
+void RayPacket::setHit(int i, const Hit& hit) {
+	// On a tie the hit found first is kept, as for a single ray
+	if (hit.rayLen < hits[i].rayLen) {
+		hits[i] = hit;
+		clip(i, hit.rayLen);
+	}
+}
+
+
+
+// Box tests
+
+// Interval version of [isHitNode]: the rays share the origin, so on each axis their distances to
+// a plane lie between the distances along the smallest & largest inverse direction.
+// False if no ray of the packet can hit the [node].
+static bool isHitFrustum(const RayPacket& packet, const FlatNode& node) {
+	const Ray& first = packet.rays[0];
+	float lowest = first.minLen;
+	float highest = -FLT_MAX;
+
+	for (int axis = 0; axis < 3; axis++) {
+		float near = (first.sign[axis] ? node.max[axis] : node.min[axis]) - first.origin[axis];
+		float far = (first.sign[axis] ? node.min[axis] : node.max[axis]) - first.origin[axis];
+
+		lowest = glm::max(lowest, glm::min(near * packet.invMin[axis], near * packet.invMax[axis]));
+		float tfar = glm::max(far * packet.invMin[axis], far * packet.invMax[axis]) * BOX_ROUNDING;
+		highest = axis == 0 ? tfar : glm::min(highest, tfar);
+	}
+
+	return lowest <= highest;
+}
+
+
+RayMask isHitNode(const RayPacket& packet, const FlatNode& node, RayMask mask, float& entry) {
+	if (packet.coherent && !isHitFrustum(packet, node)) {
+		return 0;
+	}
+
+	RayMask hit = 0;
+	entry = FLT_MAX;
+
+#ifdef PACKET_SSE
+	const Ray& first = packet.rays[0];
+	__m128 near[3];
+	__m128 far[3];
+	for (int axis = 0; axis < 3; axis++) {
+		near[axis] = _mm_set1_ps(node.min[axis] - first.origin[axis]);
+		far[axis] = _mm_set1_ps(node.max[axis] - first.origin[axis]);
+	}
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 rounding = _mm_set1_ps(BOX_ROUNDING);
+	alignas(16) float entries[4];
+
+	// 4 rays at a time
+	for (int i = 0; i < packet.count; i += 4) {
+		int lanes = (int)((mask >> i) & 15);
+		if (!lanes) {
+			continue;
+		}
+
+		__m128 lowest = _mm_set1_ps(first.minLen);
+		__m128 highest = _mm_load_ps(packet.maxLen + i);
+		for (int axis = 0; axis < 3; axis++) {
+			__m128 inv = _mm_load_ps(packet.invDirection[axis] + i);
+			__m128 t0 = _mm_mul_ps(near[axis], inv);
+			__m128 t1 = _mm_mul_ps(far[axis], inv);
+
+			// A ray going down the axis enters at max
+			__m128 negative = _mm_cmplt_ps(inv, zero);
+			__m128 tnear = _mm_or_ps(_mm_and_ps(negative, t1), _mm_andnot_ps(negative, t0));
+			__m128 tfar = _mm_or_ps(_mm_and_ps(negative, t0), _mm_andnot_ps(negative, t1));
+
+			lowest = _mm_max_ps(lowest, tnear);
+			highest = _mm_min_ps(highest, _mm_mul_ps(tfar, rounding));
+		}
+
+		lanes &= _mm_movemask_ps(_mm_cmple_ps(lowest, highest));
+		if (lanes) {
+			hit |= RayMask(lanes) << i;
+			_mm_store_ps(entries, lowest);
+			for (int lane = 0; lane < 4; lane++) {
+				if ((lanes >> lane) & 1) {
+					entry = glm::min(entry, entries[lane]);
+				}
+			}
+		}
+	}
+#else
+	while (mask) {
+		int i = nextRay(mask);
+		float rayEntry;
+		if (isHitNode(packet.rays[i], node, rayEntry)) {
+			hit |= RayMask(1) << i;
+			entry = glm::min(entry, rayEntry);
+		}
+	}
+#endif
+
+	return hit;
+}
@@ -0,0 +1,158 @@
+#ifndef packet_h // include guard
+#define packet_h
+
+#include "../models/model.h"
+#include "traversal.h"
+
+#include <glm/glm.hpp>  // glm
+#include <stdint.h>		// uint64_t
+#include <vector>		// std::vector
+
+
+// A packet holds the primary rays of PACKET_SIDE x PACKET_SIDE pixels
+const int PACKET_SIDE = 8;
+const int PACKET_RAYS = PACKET_SIDE * PACKET_SIDE;
+
+// Once fewer rays than this are left in a subtree, they go on one at a time
+const int PACKET_MIN_RAYS = 4;
+
+typedef uint64_t RayMask; // bit i stands for ray i of a packet
+
+
+inline int rayCount(RayMask mask) {
+#if defined(__GNUC__)
+	return __builtin_popcountll(mask);
+#else
+	int count = 0;
+	for (; mask; mask &= mask - 1) {
+		count++;
+	}
+	return count;
+#endif
+}
+
+
+// Index of the lowest ray of [mask], which is removed from it
+inline int nextRay(RayMask& mask) {
+	int i = 0;
+#if defined(__GNUC__)
+	i = __builtin_ctzll(mask);
+#else
+	while (!((mask >> i) & 1)) {
+		i++;
+	}
+#endif
+	mask &= mask - 1;
+	return i;
+}
+
+
+class RayPacket {
+	/// Up to PACKET_RAYS rays leaving the same point, e.g. the primary rays of a block of pixels.
+	///
+	/// Neighbouring camera rays visit almost the same nodes, so they are tested against each box
+	/// together: several rays per SIMD instruction, and whole subtrees are skipped at once when the
+	/// box is outside the frustum around the packet. Only the closest hit is searched.
+	///
+	/// [rays] act as the clipped copies of single rays: [clip] shortens a ray to its closest hit so far.
+public:
+	int count = 0;
+	Ray rays[PACKET_RAYS];
+	Hit hits[PACKET_RAYS];
+
+	/// Copies of [rays], one array per attribute, for the SIMD box tests. Set by [close]
+	alignas(16) float invDirection[3][PACKET_RAYS];
+	alignas(16) float maxLen[PACKET_RAYS];
+	float addedLen[PACKET_RAYS];
+
+	/// Frustum: the range of the inverse directions on each axis.
+	/// Only used when the rays go the same way on every axis ([coherent]).
+	bool coherent = false;
+	glm::vec3 invMin;
+	glm::vec3 invMax;
+
+	void clear();
+	void add(const Ray& ray);	// same origin as the rays already added
+	void close();				// call once every ray is added
+	Ray added(int i) const;		// ray i as it was added, before any clipping
+
+	RayMask all() const;
+	void clip(int i, float len);
+	void setHit(int i, const Hit& hit); // keeps [hit] if it's closer, and shortens the ray
+};
+
+
+// Rays of [mask] that hit the [node], and the nearest distance at which one of them enters it
+RayMask isHitNode(const RayPacket& packet, const FlatNode& node, RayMask mask, float& entry);
+
+
+/// Walks a flattened tree with the rays of [mask] together, the packet version of [traverse].
+///
+/// [hitLeaf] gets a leaf and the rays that hit its box, and should call [RayPacket::setHit] so
+/// the nodes behind the closest hits are skipped. The rays left in a subtree are traced one at a
+/// time once they are too few for a packet to pay off.
+template <typename HitLeaf>
+void traversePacket(ArrayView<FlatNode> nodes, RayPacket& packet, RayMask mask, HitLeaf hitLeaf) {
+
+	struct Entry {
+		uint32_t node;
+		RayMask rays; // that hit the node
+		float entry;
+	};
+	Entry stack[FLAT_STACK_SIZE];
+	int size = 0;
+
+	if (nodes.empty()) {
+		return;
+	}
+
+	float entry;
+	RayMask rays = isHitNode(packet, nodes[0], mask, entry);
+	if (!rays) {
+		return;
+	}
+	stack[size++] = Entry{ 0, rays, entry };
+
+	while (size > 0) {
+		Entry top = stack[--size];
+		const FlatNode& node = nodes[top.node];
+
+		if (rayCount(top.rays) < PACKET_MIN_RAYS) {
+			// Diverged
+			while (top.rays) {
+				int i = nextRay(top.rays);
+				traverse(nodes, packet.rays[i], [&](const FlatNode& leaf) {
+					hitLeaf(leaf, RayMask(1) << i);
+					return false;
+				}, top.node);
+			}
+			continue;
+		}
+
+		if (node.isLeaf) {
+			// Closer hits may have been found since the leaf was pushed
+			rays = isHitNode(packet, node, top.rays, entry);
+			if (rays) {
+				hitLeaf(node, rays);
+			}
+			continue;
+		}
+
+		// Same order as [traverse]: farthest child first, so the nearest is popped next
+		int start = size;
+		for (uint32_t c = node.first; c < node.first + node.count; c++) {
+			rays = isHitNode(packet, nodes[c], top.rays, entry);
+			if (rays) {
+				int i = size++;
+				while (i > start && stack[i - 1].entry < entry) {
+					stack[i] = stack[i - 1];
+					i--;
+				}
+				stack[i] = Entry{ c, rays, entry };
+			}
+		}
+	}
+}
+
+
+#endif packet_h
@@ -0,0 +1,359 @@
+#include "acceleration.h"
+
+#include <algorithm>	// std::partition
+#include <typeinfo>	// typeid
+
+
+/// Binary SAH tree over boxes
+
+// Below this depth a node is split at the median instead, which keeps the tree shallow
+// enough for the traversal stack even when the SAH keeps peeling off one primitive
+const int FLAT_MAX_DEPTH = 48;
+
+const int FLAT_SAH_BINS = 12;
+
+
+static int binOf(float center, float minCenter, float extent) {
+	return std::min(FLAT_SAH_BINS - 1, int(FLAT_SAH_BINS * (center - minCenter) / extent));
+}
+
+
+static void buildFlatNode(const std::vector<Bounds>& bounds, int maxLeafSize, std::vector<FlatNode>& nodes,
+	std::vector<uint32_t>& order, uint32_t begin, uint32_t end, uint32_t index, int depth) {
+
+	Bounds box;
+	Bounds centers;
+	for (uint32_t i = begin; i < end; i++) {
+		box.grow(bounds[order[i]]);
+		centers.grow(bounds[order[i]].center());
+	}
+
+	FlatNode node = FlatNode();
+	node.min = box.min;
+	node.max = box.max;
+
+	uint32_t count = end - begin;
+	if (count <= (uint32_t)maxLeafSize) {
+		node.isLeaf = 1;
+		node.first = begin;
+		node.count = count;
+		nodes[index] = node;
+		return;
+	}
+
+	// Cheapest border between bins, on any axis
+	float bestCost = FLT_MAX;
+	int bestAxis = -1;
+	int bestBin = 0;
+
+	for (int axis = 0; axis < 3 && depth < FLAT_MAX_DEPTH; axis++) {
+		float extent = centers.max[axis] - centers.min[axis];
+		if (extent <= 0.0f) {
+			continue;
+		}
+
+		Bounds bins[FLAT_SAH_BINS];
+		int binCount[FLAT_SAH_BINS] = { 0 };
+		for (uint32_t i = begin; i < end; i++) {
+			const Bounds& b = bounds[order[i]];
+			int bin = binOf(b.center()[axis], centers.min[axis], extent);
+			bins[bin].grow(b);
+			binCount[bin]++;
+		}
+
+		float rightArea[FLAT_SAH_BINS];
+		int rightCount[FLAT_SAH_BINS];
+		Bounds right;
+		int rightTotal = 0;
+		for (int bin = FLAT_SAH_BINS - 1; bin > 0; bin--) {
+			right.grow(bins[bin]);
+			rightTotal += binCount[bin];
+			rightArea[bin] = rightTotal > 0 ? right.area() : 0.0f;
+			rightCount[bin] = rightTotal;
+		}
+
+		Bounds left;
+		int leftTotal = 0;
+		for (int bin = 0; bin < FLAT_SAH_BINS - 1; bin++) {
+			left.grow(bins[bin]);
+			leftTotal += binCount[bin];
+			if (leftTotal == 0 || rightCount[bin + 1] == 0) {
+				continue;
+			}
+			float cost = left.area() * leftTotal + rightArea[bin + 1] * rightCount[bin + 1];
+			if (cost < bestCost) {
+				bestCost = cost;
+				bestAxis = axis;
+				bestBin = bin;
+			}
+		}
+	}
+
+	uint32_t middle;
+	if (bestAxis >= 0) {
+		float extent = centers.max[bestAxis] - centers.min[bestAxis];
+		float minCenter = centers.min[bestAxis];
+		middle = (uint32_t)(std::partition(order.begin() + begin, order.begin() + end, [&](uint32_t p) {
+			return binOf(bounds[p].center()[bestAxis], minCenter, extent) <= bestBin;
+		}) - order.begin());
+	}
+	else { // every center is at the same spot (or the tree got too deep), split by count
+		middle = begin + count / 2;
+	}
+
+	node.isLeaf = 0;
+	node.first = (uint32_t)nodes.size();
+	node.count = 2;
+	nodes[index] = node;
+	nodes.resize(nodes.size() + 2);
+
+	buildFlatNode(bounds, maxLeafSize, nodes, order, begin, middle, node.first, depth + 1);
+	buildFlatNode(bounds, maxLeafSize, nodes, order, middle, end, node.first + 1, depth + 1);
+}
+
+
+void buildFlatSAH(const std::vector<Bounds>& bounds, int maxLeafSize,
+	std::vector<FlatNode>& nodes, std::vector<uint32_t>& order) {
+
+	nodes.clear();
+	order.resize(bounds.size());
+	for (uint32_t i = 0; i < order.size(); i++) {
+		order[i] = i;
+	}
+
+	if (bounds.empty()) {
+		return;
+	}
+
+	nodes.reserve(2 * bounds.size());
+	nodes.push_back(FlatNode());
+	buildFlatNode(bounds, maxLeafSize, nodes, order, 0, (uint32_t)bounds.size(), 0, 0);
+}
+
+
+/// Compiled objects
+
+void SphereArray::add(Sphere* sphere) {
+	for (int axis = 0; axis < 3; axis++) {
+		center[axis].push_back(sphere->center[axis]);
+	}
+	radius.push_back(sphere->radius);
+	objects.push_back(sphere);
+}
+
+
+bool SphereArray::isHit(uint32_t i, const Ray& ray, Hit& hit) const {
+	glm::vec3 c = glm::vec3(center[0][i], center[1][i], center[2][i]);
+	if (!hitSphere(c, radius[i], ray, hit)) {
+		return false;
+	}
+	hit.object = objects[i];
+	return true;
+}
+
+
+void PlaneArray::add(Plane* plane) {
+	for (int axis = 0; axis < 3; axis++) {
+		point[axis].push_back(plane->center[axis]);
+		normal[axis].push_back(plane->normal[axis]);
+	}
+	objects.push_back(plane);
+}
+
+
+bool PlaneArray::isHit(uint32_t i, const Ray& ray, Hit& hit) const {
+	glm::vec3 p = glm::vec3(point[0][i], point[1][i], point[2][i]);
+	glm::vec3 n = glm::vec3(normal[0][i], normal[1][i], normal[2][i]);
+	if (!hitPlane(p, n, ray, hit)) {
+		return false;
+	}
+	hit.object = objects[i];
+	return true;
+}
+
+
+// Qualified calls, so the compiler knows which function runs
+bool MeshInstance::isHit(const Ray& ray, Hit& hit) const {
+	return tree ? tree->FlatHierarchy::isHit(ray, hit) : mesh->Mesh::isHit(ray, hit);
+}
+
+
+void MeshInstance::isHit(RayPacket& packet, RayMask mask) const {
+	if (tree) {
+		tree->FlatHierarchy::isHit(packet, mask);
+	}
+	else {
+		mesh->Object::isHit(packet, mask);
+	}
+}
+
+
+
+/// Top level
+
+// Small scenes end up in a single leaf: one box test, then the same loop as before
+const int SCENE_LEAF_SIZE = 4;
+
+void SceneHierarchy::build(const std::vector<Object*>& objects) {
+	std::vector<Object*> candidates;
+	std::vector<Bounds> bounds;
+
+	planes = PlaneArray();
+	unbounded.clear();
+	for (Object* object : objects) {
+		Bounds box;
+		if (object->getBounds(box.min, box.max)) {
+			candidates.push_back(object);
+			bounds.push_back(box);
+		}
+		else if (typeid(*object) == typeid(Plane)) {
+			planes.add(static_cast<Plane*>(object));
+		}
+		else {
+			unbounded.push_back(object);
+		}
+	}
+
+	std::vector<uint32_t> order;
+	buildFlatSAH(bounds, SCENE_LEAF_SIZE, nodes, order);
+
+	// The objects of each leaf are appended to the array of their type. The exact type is
+	// checked, a class derived from [Sphere] could test its hits differently.
+	spheres = SphereArray();
+	meshes.clear();
+	others.clear();
+	leaves.clear();
+	for (FlatNode& node : nodes) {
+		if (!node.isLeaf) {
+			continue;
+		}
+
+		SceneLeaf leaf = SceneLeaf();
+		leaf.spheres = (uint32_t)spheres.objects.size();
+		leaf.meshes = (uint32_t)meshes.size();
+		leaf.others = (uint32_t)others.size();
+
+		for (uint32_t i = node.first; i < node.first + node.count; i++) {
+			Object* object = candidates[order[i]];
+			const std::type_info& type = typeid(*object);
+			if (type == typeid(Sphere)) {
+				spheres.add(static_cast<Sphere*>(object));
+			}
+			else if (type == typeid(FlatHierarchy)) {
+				MeshInstance instance = MeshInstance();
+				instance.tree = static_cast<FlatHierarchy*>(object);
+				instance.mesh = instance.tree->mesh;
+				meshes.push_back(instance);
+			}
+			else if (type == typeid(Mesh)) {
+				MeshInstance instance = MeshInstance();
+				instance.mesh = static_cast<Mesh*>(object);
+				meshes.push_back(instance);
+			}
+			else {
+				others.push_back(object);
+			}
+		}
+
+		leaf.sphereCount = (uint32_t)spheres.objects.size() - leaf.spheres;
+		leaf.meshCount = (uint32_t)meshes.size() - leaf.meshes;
+		leaf.otherCount = (uint32_t)others.size() - leaf.others;
+		node.first = (uint32_t)leaves.size();
+		leaves.push_back(leaf);
+	}
+}
+
+
+void SceneHierarchy::printStats() const {
+	int bounded = (int)(spheres.objects.size() + meshes.size() + others.size());
+	printf("Scene hierarchy: %d bounded objects in %d nodes (%d spheres, %d meshes, %d others), %d planes, %d other unbounded\n",
+		bounded, (int)nodes.size(), (int)spheres.objects.size(), (int)meshes.size(), (int)others.size(),
+		(int)planes.objects.size(), (int)unbounded.size());
+}
+
+
+// Tests the objects [first, end) of one array with [isHitOne](i, ray, hit). The closest hit goes
+// to [hit] and [ray] is clipped to it. Returns true to stop, when any hit is enough.
+template <typename IsHitOne>
+static bool hitRange(uint32_t first, uint32_t end, Ray& clipped, Hit& hit, bool& found, IsHitOne isHitOne) {
+	// On a tie the object found first is kept, hence the strict comparison
+	for (uint32_t i = first; i < end; i++) {
+		Hit curr = Hit();
+		if (isHitOne(i, clipped, curr)) {
+			if (!clipped.closest) {
+				hit = curr;
+				return true;
+			}
+			if (curr.rayLen < hit.rayLen) {
+				hit = curr;
+				clipped.maxLen = curr.rayLen;
+				found = true;
+			}
+		}
+	}
+	return false;
+}
+
+
+bool SceneHierarchy::isHit(const Ray& ray, Hit & hit) {
+	bool found = false;
+	Ray clipped = ray; // gets shorter with every closer hit
+
+	auto isHitPlane = [&](uint32_t i, const Ray& r, Hit& h) { return planes.isHit(i, r, h); };
+	auto isHitUnbounded = [&](uint32_t i, const Ray& r, Hit& h) { return unbounded[i]->isHit(r, h); };
+	if (hitRange(0, (uint32_t)planes.objects.size(), clipped, hit, found, isHitPlane) ||
+		hitRange(0, (uint32_t)unbounded.size(), clipped, hit, found, isHitUnbounded)) {
+		return true;
+	}
+
+	bool stopped = traverse(nodes, clipped, [&](const FlatNode& node) {
+		const SceneLeaf& leaf = leaves[node.first];
+		return
+			hitRange(leaf.spheres, leaf.spheres + leaf.sphereCount, clipped, hit, found,
+				[&](uint32_t i, const Ray& r, Hit& h) { return spheres.isHit(i, r, h); }) ||
+			hitRange(leaf.meshes, leaf.meshes + leaf.meshCount, clipped, hit, found,
+				[&](uint32_t i, const Ray& r, Hit& h) { return meshes[i].isHit(r, h); }) ||
+			hitRange(leaf.others, leaf.others + leaf.otherCount, clipped, hit, found,
+				[&](uint32_t i, const Ray& r, Hit& h) { return others[i]->isHit(r, h); });
+	});
+
+	return found || stopped;
+}
+
+
+void SceneHierarchy::isHit(RayPacket& packet) {
+	// Same order as a single ray: the planes first, then the tree
+	for (uint32_t p = 0; p < planes.objects.size(); p++) {
+		RayMask rays = packet.all();
+		while (rays) {
+			int i = nextRay(rays);
+			Hit curr = Hit();
+			if (planes.isHit(p, packet.rays[i], curr)) {
+				packet.setHit(i, curr);
+			}
+		}
+	}
+	for (Object* object : unbounded) {
+		object->isHit(packet, packet.all());
+	}
+
+	traversePacket(nodes, packet, packet.all(), [&](const FlatNode& node, RayMask rays) {
+		const SceneLeaf& leaf = leaves[node.first];
+		for (uint32_t s = leaf.spheres; s < leaf.spheres + leaf.sphereCount; s++) {
+			RayMask left = rays;
+			while (left) {
+				int i = nextRay(left);
+				Hit curr = Hit();
+				if (spheres.isHit(s, packet.rays[i], curr)) {
+					packet.setHit(i, curr);
+				}
+			}
+		}
+		for (uint32_t m = leaf.meshes; m < leaf.meshes + leaf.meshCount; m++) {
+			meshes[m].isHit(packet, rays);
+		}
+		for (uint32_t o = leaf.others; o < leaf.others + leaf.otherCount; o++) {
+			others[o]->isHit(packet, rays);
+		}
+	});
+}
@@ -0,0 +1,120 @@
+#ifndef traversal_h // include guard
+#define traversal_h
+
+#include "../ray.h"
+#include "../utility/array_view.h"
+
+#include <glm/glm.hpp>  // glm
+#include <float.h>		// FLT_EPSILON
+#include <stdint.h>		// uint32_t
+#include <vector>		// std::vector
+
+
+struct FlatNode {
+	/// 32 bytes, so two nodes share a cache line.
+	/// The children of a node are stored next to each other.
+	glm::vec3 min;
+	uint32_t first;			// index of the first child, or of the first primitive for a leaf
+	glm::vec3 max;
+	uint32_t count : 31;	// number of children, or of primitives for a leaf
+	uint32_t isLeaf : 1;
+};
+
+
+// Enough for an octree of depth 20 (up to 7 siblings wait on the stack per level)
+// or a binary tree of depth 200
+const int FLAT_STACK_SIZE = 256;
+
+
+// The slab distances are rounded, so a ray grazing a box (or crossing a flat one, e.g. around a
+// planar leaf) can miss it by an ulp although it hits a triangle inside. Far distances are
+// pushed out by 2 * gamma(3), as in Ize, "Robust BVH Ray Traversal" (2013), so that can't happen.
+const float BOX_ROUNDING = 1.0f + 2.0f * (3.0f * 0.5f * FLT_EPSILON) / (1.0f - 3.0f * 0.5f * FLT_EPSILON);
+
+
+// Same test as [isHitBounds], kept in a header so it is inlined in the traversal loop.
+// The sign of the direction tells which side of the box is entered first on each axis,
+// so no min/max is needed to sort the slab distances.
+inline bool isHitNode(const Ray& ray, const FlatNode& node, float& entry) {
+	glm::vec3 near = glm::vec3(
+		ray.sign[0] ? node.max.x : node.min.x,
+		ray.sign[1] ? node.max.y : node.min.y,
+		ray.sign[2] ? node.max.z : node.min.z);
+	glm::vec3 far = glm::vec3(
+		ray.sign[0] ? node.min.x : node.max.x,
+		ray.sign[1] ? node.min.y : node.max.y,
+		ray.sign[2] ? node.min.z : node.max.z);
+
+	glm::vec3 tnear = (near - ray.origin) * ray.invDirection;
+	glm::vec3 tfar = (far - ray.origin) * ray.invDirection * BOX_ROUNDING;
+
+	float lowest = glm::max(ray.minLen, glm::max(tnear[0], glm::max(tnear[1], tnear[2])));
+	float highest = glm::min(ray.maxLen, glm::min(tfar[0], glm::min(tfar[1], tfar[2])));
+
+	entry = lowest;
+	return lowest <= highest;
+}
+
+
+/// Walks a flattened tree with a small explicit stack instead of recursion.
+///
+/// Children are visited nearest first. [hitLeaf] tests the primitives of a leaf; it should
+/// shrink [ray].maxLen to the closest hit so far, so the nodes further away are skipped,
+/// and return true to stop right away (e.g. any hit is enough for a shadow ray).
+/// Returns true if the traversal was stopped by [hitLeaf].
+/// [root] is the node to start from, a subtree can be walked on its own.
+template <typename HitLeaf>
+bool traverse(ArrayView<FlatNode> nodes, Ray& ray, HitLeaf hitLeaf, uint32_t root = 0) {
+
+	struct Entry {
+		uint32_t node;
+		float entry; // distance at which the ray enters the node
+	};
+	Entry stack[FLAT_STACK_SIZE];
+	int size = 0;
+
+	if (nodes.empty()) {
+		return false;
+	}
+
+	float entry;
+	if (!isHitNode(ray, nodes[root], entry)) {
+		return false;
+	}
+	stack[size++] = Entry{ root, entry };
+
+	while (size > 0) {
+		Entry top = stack[--size];
+
+		if (top.entry > ray.maxLen) {
+			continue; // a closer hit was found since this node was pushed
+		}
+
+		const FlatNode& node = nodes[top.node];
+
+		if (node.isLeaf) {
+			if (hitLeaf(node)) {
+				return true;
+			}
+			continue;
+		}
+
+		// Pushing the children that were hit, farthest first, so the nearest is popped next
+		int start = size;
+		for (uint32_t c = node.first; c < node.first + node.count; c++) {
+			if (isHitNode(ray, nodes[c], entry)) {
+				int i = size++;
+				while (i > start && stack[i - 1].entry < entry) {
+					stack[i] = stack[i - 1];
+					i--;
+				}
+				stack[i] = Entry{ c, entry };
+			}
+		}
+	}
+
+	return false;
+}
+
+
+#endif traversal_h
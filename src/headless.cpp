@@ -0,0 +1,229 @@
+// Headless renderer: traces a scene straight into memory and saves it as a .png
+// No window or OpenGL context is needed, so this can run on machines without a display.
+//
+// Usage (from the src folder, same as q1):
+//   headless <scene> [width] [height] [output.png] [options]
+//
+// The options are listed in [OPTIONS] below, which is printed on a wrong argument.
+
+#include "raytracer.h"
+#include "renderer.h"
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>  // for high_resolution_clock
+#include <string>
+#include <vector>
+
+
+const char* OPTIONS =
+	"Options:\n"
+	"  --threads N   number of worker threads, 0 = one per hardware thread (default)\n"
+	"  --tile N      tile size in pixels (default 16)\n"
+	"  --kernel K    triangle test: scalar, sse4 or avx2 (default: the widest the CPU supports)\n"
+	"  --no-packets  trace primary rays one at a time instead of as 8x8 packets\n"
+	"  --wavefront   trace the secondary rays of a tile breadth first, in sorted batches\n"
+	"  --huge-pages  allocate the scene in 2 MB aligned blocks marked for huge pages (Linux)\n"
+	"  --cache       save the loaded scene as scenes/<scene>.scene and start from it next time\n"
+	"  --bvh-stats   also build an octree for meshes using another tree, to print both costs\n"
+	"  --frames N    render N frames, the meshes twisting a little more in each: their trees are\n"
+	"                refitted between frames (with --bvh-stats, compared to new trees)\n";
+
+
+void usage(const char* program) {
+	std::cerr << "Usage: " << program << " <scene> [width] [height] [output.png] [options]\n" << OPTIONS;
+	exit(EXIT_FAILURE);
+}
+
+
+// A mesh that can move, with the vertices it was loaded with & their bounds
+struct Moving {
+	Mesh* mesh;
+	std::vector<glm::vec3> rest;
+	glm::vec3 min, max;
+
+	explicit Moving(Mesh* mesh) : mesh(mesh), rest(mesh->vertices), min(rest[0]), max(rest[0]) {
+		for (glm::vec3 point : rest) {
+			min = glm::min(min, point);
+			max = glm::max(max, point);
+		}
+	}
+};
+
+
+// Turns every vertex around the vertical axis through the center of its mesh, the top by
+// [angle] (radians) and the bottom by -[angle], as if the mesh was wrung
+void twist(std::vector<Moving>& meshes, float angle) {
+	for (Moving& moving : meshes) {
+		glm::vec3 center = (moving.min + moving.max) / 2.0f;
+		float height = std::max(moving.max.y - moving.min.y, 1e-6f);
+		for (size_t i = 0; i < moving.rest.size(); i++) {
+			glm::vec3 point = moving.rest[i] - center;
+			float turn = angle * 2.0f * point.y / height;
+			float c = std::cos(turn), s = std::sin(turn);
+			moving.mesh->vertices[i] = center + glm::vec3(c * point.x + s * point.z, point.y, c * point.z - s * point.x);
+		}
+	}
+}
+
+
+int main(int argc, char** argv) {
+	std::vector<char*> args;
+	int threads = 0;
+	int tileSize = 16;
+	bool packets = true;
+	bool wavefront = false;
+	int frames = 1;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+			threads = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--tile") == 0 && i + 1 < argc) {
+			tileSize = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--kernel") == 0 && i + 1 < argc) {
+			TriangleKernel kernel;
+			if (!parseTriangleKernel(argv[++i], kernel)) {
+				usage(argv[0]);
+			}
+			if (!setTriangleKernel(kernel)) {
+				std::cerr << "This CPU can't run the " << argv[i] << " kernel" << std::endl;
+				return EXIT_FAILURE;
+			}
+		}
+		else if (strcmp(argv[i], "--no-packets") == 0) {
+			packets = false;
+		}
+		else if (strcmp(argv[i], "--wavefront") == 0) {
+			wavefront = true;
+		}
+		else if (strcmp(argv[i], "--huge-pages") == 0) {
+			Arena::hugePages = true;
+		}
+		else if (strcmp(argv[i], "--cache") == 0) {
+			SceneAdapter::useCache = true;
+		}
+		else if (strcmp(argv[i], "--bvh-stats") == 0) {
+			SceneAdapter::compareTrees = true;
+		}
+		else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+			frames = atoi(argv[++i]);
+		}
+		else if (strncmp(argv[i], "--", 2) == 0) {
+			usage(argv[0]);
+		}
+		else {
+			args.push_back(argv[i]);
+		}
+	}
+
+	if (args.empty() || tileSize <= 0 || frames <= 0) {
+		usage(argv[0]);
+	}
+
+	char* sceneName = args[0];
+
+	Camera camera;
+	camera.width = args.size() > 1 ? atoi(args[1]) : 640;
+	camera.height = args.size() > 2 ? atoi(args[2]) : camera.width;
+	camera.packets = packets;
+	camera.wavefront = wavefront;
+
+	if (camera.width <= 0 || camera.height <= 0) {
+		std::cerr << "Invalid resolution " << camera.width << "x" << camera.height << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// The same workers load the scene, then render it
+	Scheduler scheduler(threads);
+	loadScene(sceneName, camera.fov, camera.antialiasing, camera.seed, camera.bounces, &scheduler);
+
+	// Meshes mapped from a file can't move
+	std::vector<Moving> moving;
+	if (frames > 1) {
+		for (Object* object : scene->objects) {
+			FlatHierarchy* tree = dynamic_cast<FlatHierarchy*>(object);
+			if (tree && !tree->nodeStorage.empty() && !tree->mesh->vertices.empty()) {
+				moving.emplace_back(tree->mesh);
+			}
+		}
+	}
+
+	Framebuffer framebuffer(camera.width, camera.height);
+
+	std::cout << "Starting a timer (" << scheduler.size() << " threads, "
+		<< tileSize << "x" << tileSize << " tiles, " << triangleKernelName(triangleKernel()) << " triangle test)\n";
+	std::chrono::duration<double> elapsed, rendering(0.0); // the last frame, all of them
+	std::vector<Scheduler::WorkerStats> stats; // summed over the frames
+
+	for (int frame = 0; frame < frames; frame++) {
+		if (frame > 0) {
+			twist(moving, 0.5f * (float)frame / (frames - 1));
+			scene->updateMeshes(&scheduler);
+		}
+
+		// Only the tiles are counted, not the loading or the updates between frames
+		scheduler.resetStats();
+		auto start = std::chrono::high_resolution_clock::now();
+		renderTiles(camera, framebuffer, scheduler, tileSize);
+		elapsed = std::chrono::high_resolution_clock::now() - start;
+		rendering += elapsed;
+
+		std::vector<Scheduler::WorkerStats> frameStats = scheduler.stats();
+		stats.resize(frameStats.size());
+		for (size_t i = 0; i < stats.size(); i++) {
+			stats[i].tasks += frameStats[i].tasks;
+			stats[i].steals += frameStats[i].steals;
+			stats[i].busySeconds += frameStats[i].busySeconds;
+		}
+		std::cout << "Elapsed time: " << elapsed.count() << " s\n";
+
+		std::string savePath;
+		if (args.size() > 3) {
+			savePath = args[3];
+		}
+		else { // same naming as the interactive version
+			savePath = "../rendered/[" + std::to_string(camera.width) + "x" + std::to_string(camera.height) + "] ";
+			savePath.append(sceneName);
+			savePath.append(camera.antialiasing ? " (x4) " : " ");
+			savePath.append(std::to_string((int)round(elapsed.count())));
+			savePath.append(" sec.png");
+		}
+		if (frames > 1) { // numbered before the extension, e.g. teapot_003.png
+			char number[16];
+			snprintf(number, sizeof(number), "_%03d", frame);
+			size_t dot = savePath.rfind('.');
+			if (dot == std::string::npos || savePath.find('/', dot) != std::string::npos) {
+				dot = savePath.size();
+			}
+			savePath.insert(dot, number);
+		}
+
+		if (!framebuffer.savePNG(savePath.c_str())) {
+			fprintf(stderr, "Failed Saving Image: %s\n", savePath.c_str());
+			return EXIT_FAILURE;
+		}
+		printf("Successfully Saved Image: %s\n", savePath.c_str());
+	}
+
+	// Speedup = total time spent tracing / wall time, near [threads] when the load is balanced.
+	// Only meaningful with no more threads than physical cores (otherwise busy time includes preemption).
+	double busy = 0.0;
+	long long steals = 0;
+	for (size_t i = 0; i < stats.size(); i++) {
+		printf("  thread %2d: %5lld tiles, %4lld stolen, busy %.3f s\n",
+			(int)i, stats[i].tasks, stats[i].steals, stats[i].busySeconds);
+		busy += stats[i].busySeconds;
+		steals += stats[i].steals;
+	}
+	printf("Speedup: %.2fx on %d threads (%.0f%% efficiency), %lld tiles stolen\n",
+		busy / rendering.count(), scheduler.size(),
+		100.0 * busy / (rendering.count() * scheduler.size()), steals);
+
+	pathStats.print();
+	return EXIT_SUCCESS;
+}
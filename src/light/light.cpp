@@ -27,26 +27,26 @@ glm::vec3 phong(glm::vec3 L, glm::vec3 N, glm::vec3 V,
 }
 
 
-glm::vec3 Light::apply(glm::vec3 hitPos, glm::vec3 V, glm::vec3 N, Material* material){
+glm::vec3 Light::apply(glm::vec3 hitPos, glm::vec3 V, glm::vec3 N, const Surface& surface, Random& random){
 	return glm::vec3(0,0,0);
 }
 
 
-glm::vec3 Ambient::apply(glm::vec3 hitPos, glm::vec3 V, glm::vec3 N, Material* material) {
-	return material->Ka * colour;
+glm::vec3 Ambient::apply(glm::vec3 hitPos, glm::vec3 V, glm::vec3 N, const Surface& surface, Random& random) {
+	return surface.Ka * colour;
 }
 
 
-glm::vec3 Directional::apply(glm::vec3 hitPos, glm::vec3 V, glm::vec3 N, Material* material) {
+glm::vec3 Directional::apply(glm::vec3 hitPos, glm::vec3 V, glm::vec3 N, const Surface& surface, Random& random) {
 
 	glm::vec3 L = -direction;
 
 	Ray toLight = Ray();
 	toLight.origin = hitPos;
-	toLight.direction = L;
+	toLight.setDirection(L);
 
 	if (!traceShadow(toLight)) {
-		return phong(L, N, V, material->Kd, material->Ks, material->shininess, colour);
+		return phong(L, N, V, surface.Kd, surface.Ks, surface.shininess, colour);
 	}
 	else {
 		return glm::vec3(0, 0, 0);
@@ -54,7 +54,7 @@ glm::vec3 Directional::apply(glm::vec3 hitPos, glm::vec3 V, glm::vec3 N, Materia
 }
 
 
-glm::vec3 Point::apply(glm::vec3 hitPos, glm::vec3 V, glm::vec3 N, Material* material) {
+glm::vec3 Point::apply(glm::vec3 hitPos, glm::vec3 V, glm::vec3 N, const Surface& surface, Random& random) {
 	
 	glm::vec3 L = position - hitPos;
 	float lightRayLen = length(L);
@@ -63,10 +63,10 @@ glm::vec3 Point::apply(glm::vec3 hitPos, glm::vec3 V, glm::vec3 N, Material* mat
 	Ray toLight = Ray();
 	toLight.origin = hitPos;
 	toLight.maxLen = lightRayLen;
-	toLight.direction = L;
+	toLight.setDirection(L);
 
 	if (!traceShadow(toLight)) {
-		return phong(L, N, V, material->Kd, material->Ks, material->shininess, colour);
+		return phong(L, N, V, surface.Kd, surface.Ks, surface.shininess, colour);
 	}
 	else {
 		return glm::vec3(0, 0, 0);
@@ -74,7 +74,7 @@ glm::vec3 Point::apply(glm::vec3 hitPos, glm::vec3 V, glm::vec3 N, Material* mat
 }
 
 
-glm::vec3 Spot::apply(glm::vec3 hitPos, glm::vec3 V, glm::vec3 N, Material* material) {
+glm::vec3 Spot::apply(glm::vec3 hitPos, glm::vec3 V, glm::vec3 N, const Surface& surface, Random& random) {
 
 	glm::vec3 L = position - hitPos;
 	float lightRayLen = length(L);
@@ -88,17 +88,17 @@ glm::vec3 Spot::apply(glm::vec3 hitPos, glm::vec3 V, glm::vec3 N, Material* mate
 		Ray toLight = Ray();
 		toLight.origin = hitPos;
 		toLight.maxLen = lightRayLen;
-		toLight.direction = L;
+		toLight.setDirection(L);
 
 		if (!traceShadow(toLight)) {
-			return phong(L, N, V, material->Kd, material->Ks, material->shininess, colour);
+			return phong(L, N, V, surface.Kd, surface.Ks, surface.shininess, colour);
 		}
 	}
 	return glm::vec3(0, 0, 0);
 }
 
 
-glm::vec3 Area::apply(glm::vec3 hitPos, glm::vec3 V, glm::vec3 N, Material* material) {
+glm::vec3 Area::apply(glm::vec3 hitPos, glm::vec3 V, glm::vec3 N, const Surface& surface, Random& random) {
 
 	std::vector<glm::vec3> samples;
 
@@ -106,8 +106,8 @@ glm::vec3 Area::apply(glm::vec3 hitPos, glm::vec3 V, glm::vec3 N, Material* mate
 	int noShadowSequence = 0; 
 
 	for (int i = 0; i < 20; i++) {
-		float lenU = distU * (rand() % 100 + 1) / 100.0f;
-		float lenV = distV * (rand() % 100 + 1) / 100.0f;
+		float lenU = distU * random.uniform();
+		float lenV = distV * random.uniform();
 
 		glm::vec3 currPos = position + dirU * lenU + dirV * lenV;
 
@@ -120,8 +120,8 @@ glm::vec3 Area::apply(glm::vec3 hitPos, glm::vec3 V, glm::vec3 N, Material* mate
 
 		Ray ray = Ray();
 		ray.origin = hitPos;
-		ray.maxLen = lightRayLen;
-		ray.direction = L;
+		ray.maxLen = lightRayLen - ray.minLen; // the sample is on the lamp, which must not shadow itself
+		ray.setDirection(L);
 
 		if (!traceShadow(ray)) {
 			if (prevNoShadow) {
@@ -129,10 +129,10 @@ glm::vec3 Area::apply(glm::vec3 hitPos, glm::vec3 V, glm::vec3 N, Material* mate
 			}			
 			prevNoShadow = true;
 			if (prevNoShadow > 5) {
-				return phong(L, N, V, material->Kd, material->Ks, material->shininess, colour);
+				return phong(L, N, V, surface.Kd, surface.Ks, surface.shininess, colour);
 			}
 
-			incoming = phong(L, N, V, material->Kd, material->Ks, material->shininess, colour);
+			incoming = phong(L, N, V, surface.Kd, surface.Ks, surface.shininess, colour);
 		}
 		else {			
 			prevNoShadow = false;
@@ -151,37 +151,28 @@ glm::vec3 Area::apply(glm::vec3 hitPos, glm::vec3 V, glm::vec3 N, Material* mate
 }
 
 
-Object* Area:: makeLamp() {
+Object* Area::makeLamp(Arena& arena) {
 	glm::vec3 v = dirV * distV;
 	glm::vec3 u = dirU * distU;
 	glm::vec3 o = position;
 
-	Texture* texture = new Texture();
+	Texture* texture = arena.make<Texture>();
 	texture->mode = TextureMode::checkers;
-	Material* m = new Material();
+	Material* m = arena.make<Material>();
 	m->Ka = colour;
 
-	Triangle* left = new Triangle();
-	left->material = m;
-	left->texture = texture;
-	left->points.push_back(o);
-	left->points.push_back(o + v);
-	left->points.push_back(o + v + u);
-
-	Triangle* right = new Triangle();
-	right->material = m;
-	right->texture = texture;
-	right->points.push_back(o);
-	right->points.push_back(o + v + u);
-	right->points.push_back(o + u);
-
-
-
-
-	Mesh* lamp = new Mesh();
-	lamp->triangles.push_back(left);
-	lamp->triangles.push_back(right);
-	lamp->resetNormals();
+	std::vector<glm::vec3> corners = {
+		o, o + v, o + v + u,	// left
+		o, o + v + u, o + u		// right
+	};
+
+	Mesh* lamp = arena.make<Mesh>();
+	lamp->material = m;
+	lamp->texture = texture;
+	lamp->isNegative = false;
+	lamp->setTriangles(corners);
+	lamp->pack();
+	lamp->resetOrigin();
 
 	return lamp;
 }
\ No newline at end of file
@@ -1,8 +1,9 @@
 #ifndef light_h // include guard
 #define light_h
 
-#include "../common.h"
 #include "../models/model.h"
+#include "../utility/arena.h"
+#include "../utility/random.h"
 #include "light.h"
 
 #include <glm/glm.hpp>  // glm
@@ -11,14 +12,14 @@
 
 class Light {
 public:
-	virtual glm::vec3 apply(glm::vec3 hitPos, glm::vec3 V, glm::vec3 N, Material* material);
+	virtual glm::vec3 apply(glm::vec3 hitPos, glm::vec3 V, glm::vec3 N, const Surface& surface, Random& random);
 };
 
 
 class Ambient : public Light {
 public:
 	glm::vec3 colour;
-	glm::vec3 apply(glm::vec3 hitPos, glm::vec3 V, glm::vec3 N, Material * material);
+	glm::vec3 apply(glm::vec3 hitPos, glm::vec3 V, glm::vec3 N, const Surface& surface, Random& random);
 };
 
 
@@ -26,7 +27,7 @@ class Point : public Light {
 public:
 	glm::vec3 colour;
 	glm::vec3 position;
-	glm::vec3 apply(glm::vec3 hitPos, glm::vec3 V, glm::vec3 N, Material* material);
+	glm::vec3 apply(glm::vec3 hitPos, glm::vec3 V, glm::vec3 N, const Surface& surface, Random& random);
 };
 
 
@@ -34,7 +35,7 @@ class Directional : public Light {
 public:
 	glm::vec3 colour;
 	glm::vec3 direction;
-	glm::vec3 apply(glm::vec3 hitPos, glm::vec3 V, glm::vec3 N, Material* material);
+	glm::vec3 apply(glm::vec3 hitPos, glm::vec3 V, glm::vec3 N, const Surface& surface, Random& random);
 };
 
 
@@ -45,7 +46,7 @@ public:
 	glm::vec3 direction;
 	float cutoff = 0.0f;
 
-	glm::vec3 apply(glm::vec3 hitPos, glm::vec3 V, glm::vec3 N, Material* material);
+	glm::vec3 apply(glm::vec3 hitPos, glm::vec3 V, glm::vec3 N, const Surface& surface, Random& random);
 };
 
 
@@ -59,8 +60,8 @@ public:
 	float distU = 0.0f;
 	float distV = 0.0f;
 
-	glm::vec3 apply(glm::vec3 hitPos, glm::vec3 V, glm::vec3 N, Material* material);
-	Object* makeLamp();
+	glm::vec3 apply(glm::vec3 hitPos, glm::vec3 V, glm::vec3 N, const Surface& surface, Random& random);
+	Object* makeLamp(Arena& arena);
 };
 
 
@@ -0,0 +1,114 @@
+// Converts a model to a .mesh file, which the scenes load by mapping it instead of parsing it.
+// The file holds the triangles packed the way the hit test reads them and the flattened tree
+// over them, so nothing is computed when a scene refers to it (see utility/mesh_file.h).
+//
+// Usage (from the src folder, same as headless):
+//   meshconv <model.obj | scene> <output.mesh> [options]
+//
+// A scene name (e.g. teapot) converts one of its meshes, with its transform applied.
+//
+// Options:
+//   --bvh B       tree to store: octree, sah or lbvh (default: octree, or what the scene asks for)
+//   --object N    which mesh of a scene, counting from 0 (default 0)
+
+#include "utility/scene_adapter.h"
+#include "utility/obj_loader.h"
+#include "utility/mesh_file.h"
+
+#include <chrono>	// std::chrono::high_resolution_clock
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+
+void usage(const char* program) {
+	std::cerr << "Usage: " << program << " <model.obj | scene> <output.mesh> [--bvh octree|sah|lbvh] [--object N]\n";
+	exit(EXIT_FAILURE);
+}
+
+
+int main(int argc, char** argv) {
+	std::vector<char*> args;
+	HierarchyType type = HierarchyType::octree;
+	bool typeSet = false;
+	int index = 0;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--bvh") == 0 && i + 1 < argc) {
+			if (!parseHierarchyType(argv[++i], type)) {
+				usage(argv[0]);
+			}
+			typeSet = true;
+		}
+		else if (strcmp(argv[i], "--object") == 0 && i + 1 < argc) {
+			index = atoi(argv[++i]);
+		}
+		else if (strncmp(argv[i], "--", 2) == 0) {
+			usage(argv[0]);
+		}
+		else {
+			args.push_back(argv[i]);
+		}
+	}
+
+	if (args.size() != 2) {
+		usage(argv[0]);
+	}
+
+	std::string input = args[0];
+	std::string error;
+	auto start = std::chrono::high_resolution_clock::now();
+
+	// Both ways end with a packed mesh & a flat tree over it
+	Mesh objMesh;
+	FlatHierarchy objTree;
+	SceneAdapter adapter;
+	FlatHierarchy* tree = NULL;
+
+	if (input.size() > 4 && input.compare(input.size() - 4, 4, ".obj") == 0) {
+		if (!loadObj(input, objMesh.vertices, objMesh.indices, error)) {
+			std::cerr << error << std::endl;
+			return EXIT_FAILURE;
+		}
+		objMesh.resetOrigin();
+		objMesh.pack();
+
+		Scheduler scheduler;
+		MeshHierarchy hierarchy = MeshHierarchy();
+		hierarchy.build(&objMesh, type, &scheduler);
+		hierarchy.getStats().print(hierarchyTypeName(type));
+		objTree.flatten(&hierarchy);
+		tree = &objTree;
+	}
+	else {
+		adapter.chooseScene(input.c_str());
+		if (typeSet) {
+			adapter.hierarchy = type;
+		}
+		adapter.loadThings();
+
+		int found = 0;
+		for (Object* object : adapter.objects) {
+			FlatHierarchy* flat = dynamic_cast<FlatHierarchy*>(object);
+			if (flat && found++ == index) {
+				tree = flat;
+			}
+		}
+		if (!tree) {
+			std::cerr << input << " has " << found << " meshes, no mesh " << index << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (!saveMesh(args[1], *tree->mesh, tree->nodes, error)) {
+		std::cerr << error << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+	printf("Wrote %s: %u triangles, %u vertices, %u nodes in %.3f s\n", args[1],
+		tree->mesh->triangleCount(), (unsigned)tree->mesh->vertexView.size, (unsigned)tree->nodes.size, elapsed.count());
+	return EXIT_SUCCESS;
+}
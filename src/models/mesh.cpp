@@ -1,48 +1,44 @@
 #include "model.h"
 
+#include <string.h>			// memcpy
+#include <unordered_map>	// std::unordered_map
 
-bool Mesh::isHit(Ray ray, Hit& hit) {
-	
-	Hit curr = Hit();	
 
-	if (ray.closest) {
-		for (Triangle* triangle : triangles) {
-			if (triangle->isHit(ray, curr)) {
-				if (curr.rayLen < hit.rayLen) {
-					hit = curr;
-				}
-			}
-		}
+bool Mesh::isHit(const Ray& ray, Hit& hit) {
 
-		if (hit.object != nullptr) {
-			return true;
-		}
-	}
-	else {
-		for (Triangle* triangle : triangles) {
-			if (triangle->isHit(ray, curr)) {
-				return true;
-			}
+	Hit curr = Hit();
+
+	if (isHit(ray, 0, triangleCount(), curr)) {
+		if (!ray.closest || curr.rayLen < hit.rayLen) {
+			setNormal(ray, curr);
+			hit = curr;
 		}
+		return true;
 	}
-	
+
 	return false;
 }
 
 
+bool Mesh::getBounds(glm::vec3& min, glm::vec3& max) {
+	// set by [resetOrigin]
+	min = this->min;
+	max = this->max;
+	return true;
+}
+
+
 void Mesh::resetOrigin() {
-	min = triangles[0]->points[0];
-	max = triangles[0]->points[0];
-
-	for (Triangle* triangle : triangles) {
-		for (glm::vec3 point : triangle->points) {
-			for (int i = 0; i < 3; i++) {
-				if (point[i] < min[i]) {
-					min[i] = point[i];
-				}
-				else if (point[i] > max[i]) {
-					max[i] = point[i];
-				}
+	min = vertices[0];
+	max = vertices[0];
+
+	for (glm::vec3 point : vertices) {
+		for (int i = 0; i < 3; i++) {
+			if (point[i] < min[i]) {
+				min[i] = point[i];
+			}
+			else if (point[i] > max[i]) {
+				max[i] = point[i];
 			}
 		}
 	}
@@ -51,36 +47,92 @@ void Mesh::resetOrigin() {
 
 
 
-// Transformations
+// Storage
+
+// Corners are merged when all 3 coordinates have the same bits
+struct Corner {
+	uint32_t bits[3];
+
+	bool operator==(const Corner& other) const {
+		return bits[0] == other.bits[0] && bits[1] == other.bits[1] && bits[2] == other.bits[2];
+	}
+};
+
+struct CornerHash {
+	size_t operator()(const Corner& corner) const {
+		return (corner.bits[0] * 73856093u) ^ (corner.bits[1] * 19349663u) ^ (corner.bits[2] * 83492791u);
+	}
+};
+
+
+void Mesh::setTriangles(const std::vector<glm::vec3>& corners) {
+	std::unordered_map<Corner, uint32_t, CornerHash> known;
 
-void Mesh::resetBarycenters() {
-	for (Triangle* triangle : triangles) {
-		triangle->setBarycenter();
+	vertices.clear();
+	indices.clear();
+	indices.reserve(corners.size());
+
+	for (glm::vec3 point : corners) {
+		Corner corner;
+		memcpy(corner.bits, &point[0], sizeof(corner.bits));
+
+		auto it = known.find(corner);
+		if (it == known.end()) {
+			it = known.emplace(corner, (uint32_t)vertices.size()).first;
+			vertices.push_back(point);
+		}
+		indices.push_back(it->second);
 	}
 }
 
-void Mesh::resetNormals() {
-	for (Triangle* triangle : triangles) {
-		triangle->setNormal();
+
+uint32_t Mesh::triangleCount() const {
+	return (uint32_t)(indexView.size / 3);
+}
+
+
+glm::vec3 Mesh::corner(uint32_t triangle, int k) const {
+	return vertexView[indexView[3 * triangle + k]];
+}
+
+
+size_t Mesh::memorySize() const {
+	size_t packed = 9 * coords[0][0].size * sizeof(float) + (axesU.size() + axesV.size()) * sizeof(glm::vec3);
+	return packed + vertexView.size * sizeof(glm::vec3) + indexView.size * sizeof(uint32_t);
+}
+
+
+glm::vec3 Mesh::barycenter(uint32_t triangle) const {
+	return (corner(triangle, 0) + corner(triangle, 1) + corner(triangle, 2)) / 3.0f;
+}
+
+
+void Mesh::reorder(const std::vector<uint32_t>& order) {
+	std::vector<uint32_t> reordered;
+	reordered.reserve(indices.size());
+	for (uint32_t triangle : order) {
+		reordered.insert(reordered.end(), indices.begin() + 3 * triangle, indices.begin() + 3 * triangle + 3);
 	}
+	indices.swap(reordered);
+	pack();
 }
 
+
+
+// Transformations
+
 void Mesh::translate(glm::vec3 vector) {
-	for (Triangle* triangle : triangles) {
-		for (int i = 0; i < 3; i++) {
-			triangle->points[i] += vector;
-		}
+	for (glm::vec3& point : vertices) {
+		point += vector;
 	}
 }
 
 
 void Mesh::scale(float scale) {
-	for (Triangle* triangle : triangles) {
-		for (int i = 0; i < 3; i++) {
-			glm::vec3 currPos = triangle->points[i] - center;
-			glm::vec3 newPos = currPos * scale;
-			triangle->points[i] += newPos - currPos;
-		}
+	for (glm::vec3& point : vertices) {
+		glm::vec3 currPos = point - center;
+		glm::vec3 newPos = currPos * scale;
+		point += newPos - currPos;
 	}
 }
 
@@ -90,11 +142,9 @@ void Mesh::addQuaternion(glm::vec3 axis, float angle) {
 }
 
 void Mesh::rotate() {
-	for (Triangle* triangle : triangles) {
-		for (int i = 0; i < 3; i++) {
-			glm::vec3 currPos = triangle->points[i] - center;
-			glm::vec3 newPos = currPos * mat3_cast(q);
-			triangle->points[i] += newPos - currPos;
-		}
+	for (glm::vec3& point : vertices) {
+		glm::vec3 currPos = point - center;
+		glm::vec3 newPos = currPos * mat3_cast(q);
+		point += newPos - currPos;
 	}
-}
\ No newline at end of file
+}
@@ -1,8 +1,9 @@
 #ifndef model_h // include guard
 #define model_h
 
-#include "../common.h"
+#include <stdio.h>      // printf
 #include "../utility/texture.h"
+#include "../utility/array_view.h"
 #include "../ray.h"
 
 
@@ -10,21 +11,25 @@
 #include <vector>		// std::vector
 #include <algorithm>	// std::max
 #include <math.h>       // fmod 
+#include <stdint.h>		// uint32_t
 
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
 class Object;
+class RayPacket;
+typedef uint64_t RayMask;
 
 class Hit {
 public:
 	Object* object = nullptr;
+	uint32_t primitive = 0; // which triangle, when a mesh is hit
 	glm::vec3 normal;
 	float rayLen = 999.0; // max ray len
 	bool inside = false;
 };
 
-void debug(Ray& ray, Hit& hit);
+void debug(const Ray& ray, const Hit& hit);
 
 
 class Material {
@@ -39,31 +44,56 @@ public:
 };
 
 
+class Surface {
+	/// Shading inputs evaluated at a single hit.
+	///
+	/// A [Material] is shared by every ray that hits the object, so it is never changed
+	/// after loading. Textures write their texel here instead.
+public:
+	glm::vec3 Ka;
+	glm::vec3 Kd;
+	glm::vec3 Ks;
+	float shininess;
+
+	Surface(const Material* material);
+};
+
+
 class Object {
 public:		
 	glm::vec3 center;		
-	Material * material = nullptr;
+	const Material * material = nullptr;
 	Texture* texture = nullptr;
 	bool isNegative;
 
-	virtual bool isHit(Ray ray, Hit& hit);	
-	virtual void applyTexture(glm::vec3 hitPos);	   
+	virtual ~Object() = default; // objects are deleted through base pointers (e.g. a tree's children)
+	virtual bool isHit(const Ray& ray, Hit& hit);	
+	virtual void isHit(RayPacket& packet, RayMask mask); // closest hits of the rays of [mask], one at a time by default
+	virtual bool getBounds(glm::vec3& min, glm::vec3& max); // false if the object is infinite
+	virtual void applyTexture(glm::vec3 hitPos, const Hit& hit, Surface& surface) const;	   
 	virtual void printName();
 };
 
+// The hit tests of [Sphere] & [Plane] without the object, so a compiled scene can run them on its own
+// arrays of centers & normals without a virtual call. [hit].object is left for the caller.
+bool hitSphere(glm::vec3 center, float radius, const Ray& ray, Hit& hit);
+bool hitPlane(glm::vec3 point, glm::vec3 normal, const Ray& ray, Hit& hit);
+
+
 class Sphere : public Object {
 public:
 	float radius;
-	bool isHit(Ray ray, Hit& hit) override;
+	bool isHit(const Ray& ray, Hit& hit) override;
+	bool getBounds(glm::vec3& min, glm::vec3& max) override;
 
-	void applyTexture(glm::vec3 hitPos) override;
+	void applyTexture(glm::vec3 hitPos, const Hit& hit, Surface& surface) const override;
 	void printName() override;
 };
 
 
 class Plane : public Object {
 public:
-	bool isHit(Ray ray, Hit& hit) override;
+	bool isHit(const Ray& ray, Hit& hit) override;
 
 	glm::vec3 normal;
 
@@ -71,48 +101,74 @@ public:
 	glm::vec3 axisU;
 	glm::vec3 axisV;
 	void alignTextureAxes();
-	void applyTexture(glm::vec3 hitPos);
+	void applyTexture(glm::vec3 hitPos, const Hit& hit, Surface& surface) const override;
 
 	void printName() override;
 };
 
 
-class Triangle : public Object {
-public:
-	std::vector<glm::vec3> points;	
-
-	/// Object's [normal] will change depending on the nature of the hit.
-	/// For instance, it will be different for outside & inside hits. 
-	/// A [fixedNormal] is generated when triangle is created and is based 
-	/// purely on the winding.
-	glm::vec3 normal;
-	void setNormal();
-	bool hitPlane(Ray ray, Hit& hit);
-
-	bool isHit(Ray ray, Hit& hit) override;
-	void printName() override;
-
-	// for textures
-	glm::vec3 axisU;
-	glm::vec3 axisV;
-	void applyTexture(glm::vec3 hitPos);
-
-	// for acceleration
-	int nodeID;
-	void setBarycenter();
-};
+// Leaf kernels testing a range of triangles of a [Mesh] against one ray (see triangle_simd.cpp).
+// The widest one the CPU supports is picked at startup, so one binary runs everywhere.
+enum class TriangleKernel { scalar, sse4, avx2 };
+const int MAX_TRIANGLE_LANES = 8;
 
+TriangleKernel triangleKernel();					// the kernel in use
+bool setTriangleKernel(TriangleKernel kernel);		// false (and nothing changes) if the CPU can't run it
+bool parseTriangleKernel(const char* name, TriangleKernel& kernel);
+const char* triangleKernelName(TriangleKernel kernel);
+int triangleLanes(TriangleKernel kernel);			// triangles tested per pass
 
 
 class Mesh : public Object {
-/// Holds as a set of [Triangles]
+/// Holds a set of triangles sharing one material
+///
+/// Every corner is stored once in [vertices] and referenced by [indices], three per triangle.
+/// The hit test reads a packed copy of the triangles instead, stored as structure-of-arrays
+/// (one array per coordinate), so a range of triangles is tested by walking contiguous memory,
+/// several triangles per SIMD instruction.
+///
+/// Everything past loading reads the triangles through views. They are set by [pack] to the
+/// arrays of the mesh, or point straight into a mapped mesh file (see mesh_file.h).
 ///
 /// To hit a [Mesh] the ray should hit a triangle.
 /// Note, only the closest hit is considered
 public:
-	bool isHit(Ray ray, Hit & hit) override;
+	bool isHit(const Ray& ray, Hit & hit) override;
+	bool getBounds(glm::vec3& min, glm::vec3& max) override;
+	void applyTexture(glm::vec3 hitPos, const Hit& hit, Surface& surface) const override;
+	void printName() override;
 
-	std::vector<Triangle*> triangles;
+	/// The triangles while they are loaded & transformed, read through the views once packed
+	std::vector<glm::vec3> vertices;
+	std::vector<uint32_t> indices;	// 3 per triangle
+
+	ArrayView<glm::vec3> vertexView;
+	ArrayView<uint32_t> indexView;
+
+	void setTriangles(const std::vector<glm::vec3>& corners); // 3 corners per triangle
+	uint32_t triangleCount() const;
+	glm::vec3 corner(uint32_t triangle, int k) const;
+	glm::vec3 barycenter(uint32_t triangle) const;
+	size_t memorySize() const; // bytes used by the arrays above & below
+
+	/// Packed copy of the triangles, in the order of [indices]. Rebuilt by [pack].
+	/// coords[k][axis][t] is a coordinate of corner k of triangle t. Each array is padded with
+	/// MAX_TRIANGLE_LANES - 1 zeros, so a SIMD load starting at any triangle stays in bounds.
+	ArrayView<float> coords[3][3];
+	std::vector<float> coordStorage; // the 9 arrays one after the other, unless mapped
+	glm::vec3 packed(uint32_t triangle, int k) const;
+	std::vector<glm::vec3> axesU;	// texture axes, only for a textured mesh
+	std::vector<glm::vec3> axesV;
+	void pack();
+	void setTextureAxes(); // part of [pack], a mapped mesh only needs this
+	void reorder(const std::vector<uint32_t>& order); // triangle [order[i]] becomes triangle i
+
+	// Hit tests use the packed triangles. [hit] is only written when a triangle is hit,
+	// and only the distance: the normal & side are left for [setNormal], once the closest hit is known
+	bool hitTriangle(uint32_t triangle, const Ray& ray, float maxLen, Hit& hit) const;
+	bool isHit(const Ray& ray, uint32_t first, uint32_t end, Hit& hit) const; // closest in [first, end), by [triangleKernel]
+	bool isHitScalar(const Ray& ray, uint32_t first, uint32_t end, Hit& hit) const;
+	void setNormal(const Ray& ray, Hit& hit) const;
 
 	// acceleration
 	glm::vec3 min;
@@ -120,9 +176,7 @@ public:
 	void resetOrigin();
 
 
-	// transformations
-	void resetNormals();
-	void resetBarycenters();
+	// transformations, on [vertices] (pack afterwards)
 	glm::quat q;
 	void translate(glm::vec3 vector);
 	void scale(float scale);
@@ -1,14 +1,30 @@
 #include "model.h"
-#include "../common.h"
+#include "../acceleration/packet.h"
 
 
-bool Object::isHit(Ray ray, Hit& hit) {
+bool Object::isHit(const Ray& ray, Hit& hit) {
 	/// Abstract
 	return false;
 }
 
 
-void Object::applyTexture(glm::vec3 hitPos) {
+void Object::isHit(RayPacket& packet, RayMask mask) {
+	while (mask) {
+		int i = nextRay(mask);
+		Hit curr = Hit();
+		if (isHit(packet.rays[i], curr)) {
+			packet.setHit(i, curr);
+		}
+	}
+}
+
+
+bool Object::getBounds(glm::vec3& min, glm::vec3& max) {
+	return false;
+}
+
+
+void Object::applyTexture(glm::vec3 hitPos, const Hit& hit, Surface& surface) const {
 	/// Abstract
 }
 
@@ -18,7 +34,12 @@ void Object::printName() {
 }
 
 
-void debug(Ray& ray, Hit& hit) {
+Surface::Surface(const Material* material) :
+	Ka(material->Ka), Kd(material->Kd), Ks(material->Ks), shininess(material->shininess) {
+}
+
+
+void debug(const Ray& ray, const Hit& hit) {
 	hit.object->printName();
 	printf(" HIT %s @ RayLen = %f, \n", 
 		hit.inside ? "from [Inside]" : "from [Outside]", 
@@ -1,13 +1,21 @@
 #include "model.h"
 
-bool Plane::isHit(Ray ray, Hit& hit) {
+bool Plane::isHit(const Ray& ray, Hit& hit) {
+	if (!hitPlane(center, normal, ray, hit)) {
+		return false;
+	}
+	hit.object = this;
+	return true;
+}
+
+
+bool hitPlane(glm::vec3 point, glm::vec3 normal, const Ray& ray, Hit& hit) {
 
 	float dotND = dot(normal, ray.direction);
 
 	if (dotND < 0) {
-		hit.rayLen = dot(normal, center - ray.origin) / dotND;	
+		hit.rayLen = dot(normal, point - ray.origin) / dotND;	
 		if (hit.rayLen > ray.minLen && hit.rayLen < ray.maxLen) {
-			hit.object = this;
 			hit.inside = false;
 			hit.normal = normal;
 			return true;
@@ -34,10 +42,10 @@ void Plane::alignTextureAxes() {
 }
 
 
-void Plane::applyTexture(glm::vec3 hitPos) {
+void Plane::applyTexture(glm::vec3 hitPos, const Hit& hit, Surface& surface) const {
 	float u = dot(hitPos, axisU);
 	float v = dot(hitPos, axisV);	
-	material->Ka = texture->getPixel(u, v);
+	surface.Ka = texture->getPixel(u, v);
 }
 
 
@@ -1,6 +1,15 @@
 #include "model.h"
 
-bool Sphere::isHit(Ray ray, Hit& hit) {
+bool Sphere::isHit(const Ray& ray, Hit& hit) {
+	if (!hitSphere(center, radius, ray, hit)) {
+		return false;
+	}
+	hit.object = this;
+	return true;
+}
+
+
+bool hitSphere(glm::vec3 center, float radius, const Ray& ray, Hit& hit) {
 		
 	glm::vec3 L = ray.origin - center;
 	float a = dot(ray.direction, ray.direction);
@@ -57,13 +66,18 @@ bool Sphere::isHit(Ray ray, Hit& hit) {
 	//glm::radians((float)(rand() % 160 - 80)),
 	//glm::vec3((rand() % 2), (rand() % 2), (rand() % 2)));
 
-	hit.object = this;
+	return true;
+}
+
 
+bool Sphere::getBounds(glm::vec3& min, glm::vec3& max) {
+	min = center - glm::vec3(radius);
+	max = center + glm::vec3(radius);
 	return true;
 }
 
 
-void Sphere::applyTexture(glm::vec3 hitPos) {
+void Sphere::applyTexture(glm::vec3 hitPos, const Hit& hit, Surface& surface) const {
 	// Resource used: 
 	// 1. https://people.cs.clemson.edu/~dhouse/courses/405/notes/texture-maps.pdf
 	// 2. http://www.raytracerchallenge.com/bonus/texture-mapping.html
@@ -73,7 +87,7 @@ void Sphere::applyTexture(glm::vec3 hitPos) {
 	float theta = atan2f(point.x, point.z);	
 	float u = theta / 6.2831852f;
 	float v = phi / 3.1415926f;
-	material->Ka = texture->getPixel(u, v);
+	surface.Ka = texture->getPixel(u, v);
 }
 
 
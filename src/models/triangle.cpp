@@ -1,100 +1,158 @@
 #include "model.h"
 
+/// The triangles of a [Mesh]
+
+
+bool Mesh::hitTriangle(uint32_t triangle, const Ray& ray, float maxLen, Hit& hit) const {
+	/// Watertight test (Woop, Benthin & Wald, "Watertight Ray/Triangle Intersection", 2013)
+	///
+	/// The corners are moved & sheared so the ray starts at 0 and goes along the z axis.
+	/// The ray then hits the triangle if its 2D edge functions (U, V, W) at 0 all have the
+	/// same sign. Two triangles sharing an edge compute that edge's function from the same
+	/// two corners, so a ray can't slip between them.
+	/// Both sides are accepted, the side is found later by [setNormal].
+
+	int x = ray.axes[0];
+	int y = ray.axes[1];
+	int z = ray.axes[2];
+	glm::vec3 shear = ray.shear;
+
+	glm::vec3 A = packed(triangle, 0) - ray.origin;
+	glm::vec3 B = packed(triangle, 1) - ray.origin;
+	glm::vec3 C = packed(triangle, 2) - ray.origin;
+
+	float Ax = A[x] - shear.x * A[z];
+	float Ay = A[y] - shear.y * A[z];
+	float Bx = B[x] - shear.x * B[z];
+	float By = B[y] - shear.y * B[z];
+	float Cx = C[x] - shear.x * C[z];
+	float Cy = C[y] - shear.y * C[z];
+
+	float U = Cx * By - Cy * Bx;
+	float V = Ax * Cy - Ay * Cx;
+	float W = Bx * Ay - By * Ax;
+
+	if (U == 0.0f || V == 0.0f || W == 0.0f) {
+		// Exactly on an edge: the float products can round the wrong way, double is exact here
+		U = (float)((double)Cx * By - (double)Cy * Bx);
+		V = (float)((double)Ax * Cy - (double)Ay * Cx);
+		W = (float)((double)Bx * Ay - (double)By * Ax);
+	}
 
-bool Triangle::isHit(Ray ray, Hit& hit) {
+	if ((U < 0 || V < 0 || W < 0) && (U > 0 || V > 0 || W > 0)) {
+		return false;
+	}
 
-	if (!hitPlane(ray,hit)) {
+	float det = U + V + W;
+	if (det == 0.0f) { // parallel
 		return false;
 	}
-		
-	glm::vec3 hitPos = ray.origin + hit.rayLen * ray.direction;
-	float axProj = dot(cross((points[1] - points[0]), (hitPos - points[0])), hit.normal);
-	float bxProj = dot(cross((points[2] - points[1]), (hitPos - points[1])), hit.normal);
-	float cxProj = dot(cross((points[0] - points[2]), (hitPos - points[2])), hit.normal);
-	
-	
-	if (hit.inside){
-		// INSIDE HIT	
-		if (axProj <= 0 && bxProj <= 0 && cxProj <= 0) {
-			hit.object = this;
-			return true;
-		}
-	}	
-	else { 
-		// OUTSIDE HIT
-		if (axProj >= 0 && bxProj >= 0 && cxProj >= 0) {
-			hit.object = this;
-			return true;
-		}		
-	}	
-		
-	return false;
-}
 
+	float T = U * shear.z * A[z] + V * shear.z * B[z] + W * shear.z * C[z];
+	float rayLen = T / det;
 
-bool Triangle::hitPlane(Ray ray, Hit& hit) {
-	// Similar to a infinite plane hit test, but accepting both sides 
+	if (!(rayLen > ray.minLen && rayLen < maxLen)) {
+		return false;
+	}
 
-	hit.normal = normal;
-	glm::vec3 center = points[0];
+	hit.object = const_cast<Mesh*>(this);
+	hit.primitive = triangle;
+	hit.rayLen = rayLen;
+	return true;
+}
 
-	float dotND = dot(hit.normal, ray.direction);
 
-	if (dotND < 0) {
-		// Normal and Ray pointing in different directions
-		hit.inside = false;
-	}
-	else if (dotND > 0) {
-		// Normal and Ray pointing in the same directions
-		hit.inside = true;
-		dotND = -dotND;
-		hit.normal *= -1;
-	}
-	else { // parallel
-		return false;
+bool Mesh::isHitScalar(const Ray& ray, uint32_t first, uint32_t end, Hit& hit) const {
+	bool found = false;
+	float maxLen = ray.maxLen;
+
+	for (uint32_t i = first; i < end; i++) {
+		if (hitTriangle(i, ray, maxLen, hit)) {
+			if (!ray.closest) {
+				return true;
+			}
+			// Only closer triangles can be hit from now on
+			maxLen = hit.rayLen;
+			found = true;
+		}
 	}
+	return found;
+}
 
-	hit.rayLen = dot(hit.normal, center - ray.origin) / dotND;
 
-	if (hit.rayLen > ray.minLen&& hit.rayLen < ray.maxLen) {
-		return true;
+void Mesh::setNormal(const Ray& ray, Hit& hit) const {
+	// Based purely on the winding, flipped for inside hits
+	glm::vec3 p0 = packed(hit.primitive, 0);
+	hit.normal = normalize(cross((packed(hit.primitive, 1) - p0), (packed(hit.primitive, 2) - p0)));
+	hit.inside = dot(hit.normal, ray.direction) > 0; // the ray goes the same way as the normal
+	if (hit.inside) {
+		hit.normal *= -1;
 	}
-	return false;
 }
 
 
-void Triangle::applyTexture(glm::vec3 hitPos) {
-	float u = dot(hitPos, axisU);
-	float v = dot(hitPos, axisV);
-	material->Ka = texture->getPixel(u, v);
+void Mesh::pack() {
+	vertexView = vertices;
+	indexView = indices;
+	uint32_t count = triangleCount();
+
+	size_t stride = count + MAX_TRIANGLE_LANES - 1;
+	coordStorage.assign(9 * stride, 0.0f);
+	for (int k = 0; k < 3; k++) {
+		for (int axis = 0; axis < 3; axis++) {
+			float* array = &coordStorage[(3 * k + axis) * stride];
+			for (uint32_t i = 0; i < count; i++) {
+				array[i] = corner(i, k)[axis];
+			}
+			coords[k][axis] = ArrayView<float>(array, stride);
+		}
+	}
+
+	setTextureAxes();
 }
 
 
-void Triangle::setNormal() {
-	normal = normalize(cross((points[1] - points[0]), (points[2] - points[0])));
+void Mesh::setTextureAxes() {
+	uint32_t count = triangleCount();
+	axesU.clear();
+	axesV.clear();
+	if (texture == nullptr || texture->mode == TextureMode::none) {
+		return;
+	}
+
+	axesU.resize(count);
+	axesV.resize(count);
+	for (uint32_t i = 0; i < count; i++) {
+		glm::vec3 p0 = packed(i, 0);
+		glm::vec3 normal = normalize(cross((packed(i, 1) - p0), (packed(i, 2) - p0)));
+
+		// For the textures. Simply projecting it from a plane to a triangle.
+		// Need to know the longest axis.
+		glm::vec3 a = cross(normal, glm::vec3(1, 0, 0));
+		glm::vec3 b = cross(normal, glm::vec3(0, 1, 0));
+		glm::vec3 c = cross(normal, glm::vec3(0, 0, 1));
+
+		// Note, the dot product of a vector with itself is the square of its magnitude
+		glm::vec3 axisU = dot(a, a) > dot(b, b) ? a : b;
+		axesU[i] = normalize(dot(axisU, axisU) > dot(c, c) ? axisU : c);
+		axesV[i] = normalize(cross(normal, axesU[i]));
+	}
+}
 
-	// For the textures. Simply projecting it from a plane to a triangle.
-	// Need to know the longest axis.
-	glm::vec3 a = cross(normal, glm::vec3(1, 0, 0));
-	glm::vec3 b = cross(normal, glm::vec3(0, 1, 0));
-	glm::vec3 c = cross(normal, glm::vec3(0, 0, 1));
 
-	// Note, the dot product of a vector with itself is the square of its magnitude
-	axisU = dot(a, a) > dot(b, b) ? a : b;
-	axisU = normalize(dot(axisU, axisU) > dot(c, c) ? axisU : c);
-	axisV = normalize(cross(normal, axisU));
+glm::vec3 Mesh::packed(uint32_t triangle, int k) const {
+	return glm::vec3(coords[k][0][triangle], coords[k][1][triangle], coords[k][2][triangle]);
 }
 
 
-void Triangle::setBarycenter() {
-	glm::vec3 curr;
-	for (glm::vec3 p : points) {
-		curr += p;
-	}
-	center = curr / 3.0f;
+void Mesh::applyTexture(glm::vec3 hitPos, const Hit& hit, Surface& surface) const {
+	// Set by [pack]
+	float u = dot(hitPos, axesU[hit.primitive]);
+	float v = dot(hitPos, axesV[hit.primitive]);
+	surface.Ka = texture->getPixel(u, v);
 }
 
 
-void Triangle::printName() {
-	printf("Triangle");
-}
\ No newline at end of file
+void Mesh::printName() {
+	printf("Triangle"); // only hits are printed, and those are on a triangle
+}
@@ -0,0 +1,321 @@
+#include "model.h"
+
+#include <string.h>		// strcmp
+
+/// SIMD versions of the triangle test of a [Mesh], 4 (SSE4) or 8 (AVX2) triangles per pass.
+///
+/// Same watertight test as [Mesh::hitTriangle], one triangle per lane: every lane does the
+/// same float operations in the same order, so a lane gives exactly the scalar result.
+/// A lane exactly on an edge (U, V or W == 0) is redone by [hitTriangle] for its double fallback.
+///
+/// The functions are compiled for their instruction set with a target attribute rather than
+/// a compiler flag, and only called when the CPU supports it. FMA is left off on purpose:
+/// contracting a * b - c would round differently from the scalar test.
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define TRIANGLE_SIMD
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>		// __cpuid, _xgetbv
+#define SIMD_TARGET(isa)
+#else
+#define SIMD_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+
+#ifdef TRIANGLE_SIMD
+
+static bool cpuSupports(TriangleKernel kernel) {
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 1);
+	bool sse4 = (info[2] & (1 << 19)) != 0;
+	bool osAvx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6;
+	__cpuid(info, 0);
+	bool avx2 = false;
+	if (info[0] >= 7) {
+		__cpuidex(info, 7, 0);
+		avx2 = osAvx && (info[1] & (1 << 5)) != 0;
+	}
+#else
+	__builtin_cpu_init();
+	bool sse4 = __builtin_cpu_supports("sse4.1");
+	bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+	switch (kernel) {
+	case TriangleKernel::avx2:	return avx2;
+	case TriangleKernel::sse4:	return sse4;
+	default:					return true;
+	}
+}
+
+
+// Lanes that hit a triangle between [minLen] and [maxLen] are tested once more in order by
+// [takeLanes], so the first closest triangle wins, as in the scalar loop
+static bool takeLanes(const Mesh& mesh, const Ray& ray, uint32_t first, int hits, int edges,
+	const float* rayLens, float& maxLen, Hit& hit, bool& found) {
+
+	for (int lane = 0; (hits | edges) >> lane; lane++) {
+		uint32_t triangle = first + lane;
+		bool hitLane = false;
+
+		if ((edges >> lane) & 1) {
+			hitLane = mesh.hitTriangle(triangle, ray, maxLen, hit);
+		}
+		else if (((hits >> lane) & 1) && rayLens[lane] < maxLen) {
+			hit.object = const_cast<Mesh*>(&mesh);
+			hit.primitive = triangle;
+			hit.rayLen = rayLens[lane];
+			hitLane = true;
+		}
+
+		if (hitLane) {
+			found = true;
+			if (!ray.closest) {
+				return true;
+			}
+			maxLen = hit.rayLen;
+		}
+	}
+	return false;
+}
+
+
+SIMD_TARGET("sse4.1")
+static bool isHitSse4(const Mesh& mesh, const Ray& ray, uint32_t first, uint32_t end, Hit& hit) {
+	int x = ray.axes[0];
+	int y = ray.axes[1];
+	int z = ray.axes[2];
+
+	const __m128 ox = _mm_set1_ps(ray.origin[x]);
+	const __m128 oy = _mm_set1_ps(ray.origin[y]);
+	const __m128 oz = _mm_set1_ps(ray.origin[z]);
+	const __m128 sx = _mm_set1_ps(ray.shear.x);
+	const __m128 sy = _mm_set1_ps(ray.shear.y);
+	const __m128 sz = _mm_set1_ps(ray.shear.z);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 minLen = _mm_set1_ps(ray.minLen);
+	const __m128i laneIds = _mm_setr_epi32(0, 1, 2, 3);
+
+	const float* p[3][3];
+	for (int k = 0; k < 3; k++) {
+		p[k][0] = mesh.coords[k][x].data;
+		p[k][1] = mesh.coords[k][y].data;
+		p[k][2] = mesh.coords[k][z].data;
+	}
+
+	float maxLen = ray.maxLen;
+	bool found = false;
+	alignas(16) float rayLens[4];
+
+	for (uint32_t i = first; i < end; i += 4) {
+		// Corners moved to the ray origin & sheared, as in [hitTriangle]
+		__m128 Az = _mm_sub_ps(_mm_loadu_ps(p[0][2] + i), oz);
+		__m128 Bz = _mm_sub_ps(_mm_loadu_ps(p[1][2] + i), oz);
+		__m128 Cz = _mm_sub_ps(_mm_loadu_ps(p[2][2] + i), oz);
+		__m128 Ax = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(p[0][0] + i), ox), _mm_mul_ps(sx, Az));
+		__m128 Ay = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(p[0][1] + i), oy), _mm_mul_ps(sy, Az));
+		__m128 Bx = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(p[1][0] + i), ox), _mm_mul_ps(sx, Bz));
+		__m128 By = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(p[1][1] + i), oy), _mm_mul_ps(sy, Bz));
+		__m128 Cx = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(p[2][0] + i), ox), _mm_mul_ps(sx, Cz));
+		__m128 Cy = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(p[2][1] + i), oy), _mm_mul_ps(sy, Cz));
+
+		__m128 U = _mm_sub_ps(_mm_mul_ps(Cx, By), _mm_mul_ps(Cy, Bx));
+		__m128 V = _mm_sub_ps(_mm_mul_ps(Ax, Cy), _mm_mul_ps(Ay, Cx));
+		__m128 W = _mm_sub_ps(_mm_mul_ps(Bx, Ay), _mm_mul_ps(By, Ax));
+
+		// Lanes past [end] read the next leaf (or the padding) and are dropped
+		__m128 active = _mm_castsi128_ps(_mm_cmpgt_epi32(_mm_set1_epi32((int)(end - i)), laneIds));
+
+		__m128 onEdge = _mm_or_ps(_mm_or_ps(_mm_cmpeq_ps(U, zero), _mm_cmpeq_ps(V, zero)), _mm_cmpeq_ps(W, zero));
+		__m128 negative = _mm_or_ps(_mm_or_ps(_mm_cmplt_ps(U, zero), _mm_cmplt_ps(V, zero)), _mm_cmplt_ps(W, zero));
+		__m128 positive = _mm_or_ps(_mm_or_ps(_mm_cmpgt_ps(U, zero), _mm_cmpgt_ps(V, zero)), _mm_cmpgt_ps(W, zero));
+
+		__m128 det = _mm_add_ps(_mm_add_ps(U, V), W);
+		__m128 T = _mm_add_ps(_mm_add_ps(
+			_mm_mul_ps(_mm_mul_ps(U, sz), Az),
+			_mm_mul_ps(_mm_mul_ps(V, sz), Bz)),
+			_mm_mul_ps(_mm_mul_ps(W, sz), Cz));
+		__m128 rayLen = _mm_div_ps(T, det);
+
+		__m128 valid = _mm_andnot_ps(_mm_and_ps(negative, positive), active);
+		valid = _mm_andnot_ps(onEdge, valid);
+		valid = _mm_and_ps(valid, _mm_cmpneq_ps(det, zero));
+		valid = _mm_and_ps(valid, _mm_cmpgt_ps(rayLen, minLen));
+		valid = _mm_and_ps(valid, _mm_cmplt_ps(rayLen, _mm_set1_ps(maxLen)));
+
+		int hits = _mm_movemask_ps(valid);
+		int edges = _mm_movemask_ps(_mm_and_ps(onEdge, active));
+		if (hits | edges) {
+			_mm_store_ps(rayLens, rayLen);
+			if (takeLanes(mesh, ray, i, hits, edges, rayLens, maxLen, hit, found)) {
+				return true;
+			}
+		}
+	}
+	return found;
+}
+
+
+SIMD_TARGET("avx2")
+static bool isHitAvx2(const Mesh& mesh, const Ray& ray, uint32_t first, uint32_t end, Hit& hit) {
+	int x = ray.axes[0];
+	int y = ray.axes[1];
+	int z = ray.axes[2];
+
+	const __m256 ox = _mm256_set1_ps(ray.origin[x]);
+	const __m256 oy = _mm256_set1_ps(ray.origin[y]);
+	const __m256 oz = _mm256_set1_ps(ray.origin[z]);
+	const __m256 sx = _mm256_set1_ps(ray.shear.x);
+	const __m256 sy = _mm256_set1_ps(ray.shear.y);
+	const __m256 sz = _mm256_set1_ps(ray.shear.z);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 minLen = _mm256_set1_ps(ray.minLen);
+	const __m256i laneIds = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+	const float* p[3][3];
+	for (int k = 0; k < 3; k++) {
+		p[k][0] = mesh.coords[k][x].data;
+		p[k][1] = mesh.coords[k][y].data;
+		p[k][2] = mesh.coords[k][z].data;
+	}
+
+	float maxLen = ray.maxLen;
+	bool found = false;
+	alignas(32) float rayLens[8];
+
+	for (uint32_t i = first; i < end; i += 8) {
+		// Corners moved to the ray origin & sheared, as in [hitTriangle]
+		__m256 Az = _mm256_sub_ps(_mm256_loadu_ps(p[0][2] + i), oz);
+		__m256 Bz = _mm256_sub_ps(_mm256_loadu_ps(p[1][2] + i), oz);
+		__m256 Cz = _mm256_sub_ps(_mm256_loadu_ps(p[2][2] + i), oz);
+		__m256 Ax = _mm256_sub_ps(_mm256_sub_ps(_mm256_loadu_ps(p[0][0] + i), ox), _mm256_mul_ps(sx, Az));
+		__m256 Ay = _mm256_sub_ps(_mm256_sub_ps(_mm256_loadu_ps(p[0][1] + i), oy), _mm256_mul_ps(sy, Az));
+		__m256 Bx = _mm256_sub_ps(_mm256_sub_ps(_mm256_loadu_ps(p[1][0] + i), ox), _mm256_mul_ps(sx, Bz));
+		__m256 By = _mm256_sub_ps(_mm256_sub_ps(_mm256_loadu_ps(p[1][1] + i), oy), _mm256_mul_ps(sy, Bz));
+		__m256 Cx = _mm256_sub_ps(_mm256_sub_ps(_mm256_loadu_ps(p[2][0] + i), ox), _mm256_mul_ps(sx, Cz));
+		__m256 Cy = _mm256_sub_ps(_mm256_sub_ps(_mm256_loadu_ps(p[2][1] + i), oy), _mm256_mul_ps(sy, Cz));
+
+		__m256 U = _mm256_sub_ps(_mm256_mul_ps(Cx, By), _mm256_mul_ps(Cy, Bx));
+		__m256 V = _mm256_sub_ps(_mm256_mul_ps(Ax, Cy), _mm256_mul_ps(Ay, Cx));
+		__m256 W = _mm256_sub_ps(_mm256_mul_ps(Bx, Ay), _mm256_mul_ps(By, Ax));
+
+		// Lanes past [end] read the next leaf (or the padding) and are dropped
+		__m256 active = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32((int)(end - i)), laneIds));
+
+		__m256 onEdge = _mm256_or_ps(_mm256_or_ps(
+			_mm256_cmp_ps(U, zero, _CMP_EQ_OQ),
+			_mm256_cmp_ps(V, zero, _CMP_EQ_OQ)),
+			_mm256_cmp_ps(W, zero, _CMP_EQ_OQ));
+		__m256 negative = _mm256_or_ps(_mm256_or_ps(
+			_mm256_cmp_ps(U, zero, _CMP_LT_OQ),
+			_mm256_cmp_ps(V, zero, _CMP_LT_OQ)),
+			_mm256_cmp_ps(W, zero, _CMP_LT_OQ));
+		__m256 positive = _mm256_or_ps(_mm256_or_ps(
+			_mm256_cmp_ps(U, zero, _CMP_GT_OQ),
+			_mm256_cmp_ps(V, zero, _CMP_GT_OQ)),
+			_mm256_cmp_ps(W, zero, _CMP_GT_OQ));
+
+		__m256 det = _mm256_add_ps(_mm256_add_ps(U, V), W);
+		__m256 T = _mm256_add_ps(_mm256_add_ps(
+			_mm256_mul_ps(_mm256_mul_ps(U, sz), Az),
+			_mm256_mul_ps(_mm256_mul_ps(V, sz), Bz)),
+			_mm256_mul_ps(_mm256_mul_ps(W, sz), Cz));
+		__m256 rayLen = _mm256_div_ps(T, det);
+
+		__m256 valid = _mm256_andnot_ps(_mm256_and_ps(negative, positive), active);
+		valid = _mm256_andnot_ps(onEdge, valid);
+		valid = _mm256_and_ps(valid, _mm256_cmp_ps(det, zero, _CMP_NEQ_UQ));
+		valid = _mm256_and_ps(valid, _mm256_cmp_ps(rayLen, minLen, _CMP_GT_OQ));
+		valid = _mm256_and_ps(valid, _mm256_cmp_ps(rayLen, _mm256_set1_ps(maxLen), _CMP_LT_OQ));
+
+		int hits = _mm256_movemask_ps(valid);
+		int edges = _mm256_movemask_ps(_mm256_and_ps(onEdge, active));
+		if (hits | edges) {
+			_mm256_store_ps(rayLens, rayLen);
+			if (takeLanes(mesh, ray, i, hits, edges, rayLens, maxLen, hit, found)) {
+				return true;
+			}
+		}
+	}
+	return found;
+}
+
+#else // no SIMD kernels on this architecture
+
+static bool cpuSupports(TriangleKernel kernel) {
+	return kernel == TriangleKernel::scalar;
+}
+
+#endif
+
+
+
+// Dispatch
+
+static TriangleKernel bestKernel() {
+	if (cpuSupports(TriangleKernel::avx2)) {
+		return TriangleKernel::avx2;
+	}
+	if (cpuSupports(TriangleKernel::sse4)) {
+		return TriangleKernel::sse4;
+	}
+	return TriangleKernel::scalar;
+}
+
+static TriangleKernel currentKernel = bestKernel();
+
+
+TriangleKernel triangleKernel() {
+	return currentKernel;
+}
+
+
+bool setTriangleKernel(TriangleKernel kernel) {
+	if (!cpuSupports(kernel)) {
+		return false;
+	}
+	currentKernel = kernel;
+	return true;
+}
+
+
+bool parseTriangleKernel(const char* name, TriangleKernel& kernel) {
+	for (TriangleKernel candidate : { TriangleKernel::scalar, TriangleKernel::sse4, TriangleKernel::avx2 }) {
+		if (strcmp(name, triangleKernelName(candidate)) == 0) {
+			kernel = candidate;
+			return true;
+		}
+	}
+	return false;
+}
+
+
+const char* triangleKernelName(TriangleKernel kernel) {
+	switch (kernel) {
+	case TriangleKernel::avx2:	return "avx2";
+	case TriangleKernel::sse4:	return "sse4";
+	default:					return "scalar";
+	}
+}
+
+
+int triangleLanes(TriangleKernel kernel) {
+	switch (kernel) {
+	case TriangleKernel::avx2:	return 8;
+	case TriangleKernel::sse4:	return 4;
+	default:					return 1;
+	}
+}
+
+
+bool Mesh::isHit(const Ray& ray, uint32_t first, uint32_t end, Hit& hit) const {
+	switch (currentKernel) {
+#ifdef TRIANGLE_SIMD
+	case TriangleKernel::avx2:	return isHitAvx2(*this, ray, first, end, hit);
+	case TriangleKernel::sse4:	return isHitSse4(*this, ray, first, end, hit);
+#endif
+	default:					return isHitScalar(ray, first, end, hit);
+	}
+}
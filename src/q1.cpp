@@ -2,17 +2,15 @@
 
 #include "common.h"
 #include "raytracer.h"
+#include "renderer.h"
 #include <iostream>
 #include <cmath>
 #include <glm/glm.hpp>
 #include <chrono>  // for high_resolution_clock
 
-#define STB_IMAGE_WRITE_IMPLEMENTATION 
 #include "utility/stb_image_write.h" // to save rendered images, https://github.com/nothings/stb 
 #include <string>
 
-#define M_PI 3.14159265358979323846264338327950288
-
 const char *WINDOW_TITLE = "Ray Tracing";
 const double FRAME_RATE_MS = 1;
 
@@ -25,10 +23,7 @@ GLuint Window;
 int vp_width, vp_height;
 float drawing_y = 0;
 
-bool antialiasing;
-float fov;
-point3 eye;
-float d = 1;
+Camera camera;
 
 
 std::chrono::time_point<std::chrono::high_resolution_clock> start;
@@ -100,28 +95,10 @@ int captureScreenshot(std::string savePath)
 
 //----------------------------------------------------------------------------
 
-point3 s(int x, int y, float offsetX = 0.0, float offsetY = 0.0 ) {
-	float aspect_ratio = (float)vp_width / vp_height;
-	float h = d * (float)tan((M_PI * fov) / 180.0 / 2.0);
-	float w = h * aspect_ratio;
-   
-	float top = h;
-	float bottom = -h;
-	float left = -w;
-	float right = w;
-   
-	float u = left + (right - left) * (x + 0.5f + offsetX) / vp_width;
-	float v = bottom + (top - bottom) * (y + 0.5f + offsetY) / vp_height;
-   
-	return point3(u, v, -d);
-}
-
-//----------------------------------------------------------------------------
-
 // OpenGL initialization
 void init(char *fn) {
 	sceneName = fn;
-	loadScene(fn, fov, antialiasing); // Importing to my own data structure! 
+	loadScene(fn, camera.fov, camera.antialiasing, camera.seed, camera.bounces); // Importing to my own data structure! 
 
 	// Create a vertex array object
 	GLuint vao;
@@ -184,45 +161,15 @@ void display( void ) {
 		// only recalculate if this is a new scanline
 		if (drawing_y == int(drawing_y)) {
 
-			for (int x = 0; x < vp_width; x++) {				
-
-				if (antialiasing)
-				{
-					float offset = 0.25;
-					std::vector<glm::vec3> samples;
-					std::vector<glm::vec3> rays;
-
-					glm::vec3 rayDir = s(x, y);
-					rays.push_back(normalize(s(x, y, +offset, +offset) - eye));
-					rays.push_back(normalize(s(x, y, +offset, -offset) - eye));
-					rays.push_back(normalize(s(x, y, -offset, +offset) - eye));
-					rays.push_back(normalize(s(x, y, -offset, -offset) - eye));
-
-					for (glm::vec3 rayDir : rays) {
-						Ray ray = Ray();
-						ray.origin = eye;
-						ray.direction = rayDir;
-						samples.push_back(
-							trace(ray));
-					}
-
-					glm::vec3 out;
-					for (glm::vec3 colour : samples) {
-						out += colour;
-					}
-					texture[x] = out / (float)samples.size();
+			for (int x = 0; x < vp_width; x += PACKET_SIDE) {
+				int endX = std::min(x + PACKET_SIDE, vp_width);
+				if (camera.packets) {
+					camera.traceBlock(x, y, endX, y + 1, &texture[x]);
+					continue;
 				}
-				else {
-					glm::vec3 rayDir = normalize(s(x, y) - eye);
-					Ray ray = Ray();
-					ray.origin = eye;
-					ray.direction = rayDir;
-					texture[x] = trace(ray);
+				for (int px = x; px < endX; px++) {
+					texture[px] = camera.tracePixel(px, y);
 				}
-	
-				
-
-								
 			}
 
 			// to ensure a power-of-two texture, get the next highest power of two
@@ -265,7 +212,7 @@ void display( void ) {
 		savePath.append(std::to_string(vp_height));
 		savePath.append("] ");
 		savePath.append(sceneName);
-		if (antialiasing) {
+		if (camera.antialiasing) {
 			savePath.append(" (x4) ");
 		}
 		else {
@@ -299,13 +246,10 @@ void mouse( int button, int state, int x, int y ) {
 	if ( state == GLUT_DOWN ) {
 		switch( button ) {
 		case GLUT_LEFT_BUTTON:
-			colour3 c;
-			point3 uvw = s(x, y);
 			std::cout << "\n\nCASTING A RAY\n\n";
-			glm::vec3 rayDir = normalize(s(x, y) - eye);
-			Ray ray = Ray();
-			ray.origin = eye;
-			ray.direction = rayDir;
+			Ray ray = camera.primaryRay(x, y);
+			Random random = camera.pixelRandom(x, y);
+			ray.random = &random;
 			ray.debugOn = true;
 			trace(ray);			
 			break;
@@ -328,6 +272,8 @@ void reshape( int width, int height ) {
 	// glUniformMatrix4fv( Projection, 1, GL_FALSE, glm::value_ptr(projection) );
 	vp_width = width;
 	vp_height = height;
+	camera.width = width;
+	camera.height = height;
 	glUniform2f( Window, width, height );
 	drawing_y = 0;
 }
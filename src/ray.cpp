@@ -1,14 +1,37 @@
 #include "ray.h"
 
+#include <utility>  // std::swap
+
+void Ray::setDirection(glm::vec3 direction) {
+	this->direction = direction;
+	invDirection = 1.0f / direction;
+	sign[0] = invDirection.x < 0;
+	sign[1] = invDirection.y < 0;
+	sign[2] = invDirection.z < 0;
+
+	glm::vec3 size = glm::abs(direction);
+	int z = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+	int x = (z + 1) % 3;
+	int y = (x + 1) % 3;
+	if (direction[z] < 0) {
+		std::swap(x, y); // keeps the winding of the triangles
+	}
+	axes[0] = x;
+	axes[1] = y;
+	axes[2] = z;
+	shear = glm::vec3(direction[x] / direction[z], direction[y] / direction[z], 1.0f / direction[z]);
+}
+
+
 void Ray::turnBackAt(glm::vec3 hitPos) {
 	origin = hitPos;
-	direction = -direction;
+	setDirection(-direction);
 }
 
 
 void Ray::reflect(glm::vec3 hitPos, glm::vec3 N, glm::vec3 V) {
 	origin = hitPos;
-	direction = normalize(2 * dot(N, V) * N - V);
+	setDirection(normalize(2 * dot(N, V) * N - V));
 }
 
 
@@ -19,7 +42,7 @@ bool Ray::refract(glm::vec3 hitPos, glm::vec3 N, float eta, bool inside) {
 	float dotIN = dot(direction, N);
 
 	if (!inside) {
-		eta = 1.0 / eta;
+		eta = 1.0f / eta;
 	}
 	   	
 	float k = 1 - eta * eta * (1 - dotIN * dotIN);
@@ -29,13 +52,13 @@ bool Ray::refract(glm::vec3 hitPos, glm::vec3 N, float eta, bool inside) {
 			return false;
 		}
 		else {
-			direction = normalize(eta * (direction - N * dotIN) - N * sqrt(k));
+			setDirection(normalize(eta * (direction - N * dotIN) - N * sqrtf(k)));
 			return true;
 		}
 	}
 	else {
 		//assert(k > 0);
-		direction = normalize(eta * (direction - N * dotIN) - N * sqrt(k));
+		setDirection(normalize(eta * (direction - N * dotIN) - N * sqrtf(k)));
 		return true;
 	}
 
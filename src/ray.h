@@ -3,10 +3,21 @@
 
 #include <glm/glm.hpp>  // glm
 
+class Random;
+
 class Ray {
 public:
 	glm::vec3 origin;
-	glm::vec3 direction;
+	glm::vec3 direction;	// change through [setDirection], so the members below stay in sync
+
+	/// Cached for the box tests, which run far more often than the direction changes
+	glm::vec3 invDirection;	// 1 / direction
+	int sign[3] = { 0, 0, 0 };	// 1 if direction is negative on that axis, i.e. the ray enters a box at max
+
+	/// Cached for the triangle test, which looks along the dominant axis [axes][2]
+	/// and shears the triangle so the ray becomes that axis
+	int axes[3] = { 0, 1, 2 };
+	glm::vec3 shear;
 
 	float minLen = 0.0001f;
 	float maxLen = 999.0f;
@@ -15,12 +26,16 @@ public:
 	bool closest = true;
 	bool debugOn = false;
 
+	void setDirection(glm::vec3 direction);
 	void turnBackAt(glm::vec3 hitPos);
 	void reflect(glm::vec3 hitPos, glm::vec3 N, glm::vec3 V);
 	bool refract(glm::vec3 hitPos, glm::vec3 N, float eta, bool inside);
 
 	bool blendingMode = false;
 	bool negativeOn = false;
+
+	// Samples area lights. Set for primary rays, secondary rays inherit it
+	Random* random = nullptr;
 };
 
 #endif ray_h
\ No newline at end of file
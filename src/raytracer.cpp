@@ -1,25 +1,30 @@
 #include "raytracer.h"
 
+#include <utility>	// std::swap
+
 /// Scene 
 
 SceneAdapter* scene;
 
-void loadScene(char* fn, float& fov, bool& antialiasing) {
+void loadScene(char* fn, float& fov, bool& antialiasing, unsigned& seed, int& bounces, Scheduler* scheduler) {
+	delete scene; // with everything it loaded
 	scene = new SceneAdapter();
 	scene->chooseScene(fn);
-	scene->loadThings();
+	scene->loadThings(scheduler);
 	fov = scene->fov;
 	antialiasing = scene->antialiasing;
+	seed = scene->seed;
+	bounces = scene->bounces;
 }
 
 /// Lights & Shadows
 
-glm::vec3 applyLights(glm::vec3 hitPos, glm::vec3 V, glm::vec3 N, Material* material) {
+glm::vec3 applyLights(glm::vec3 hitPos, glm::vec3 V, glm::vec3 N, const Surface& surface, Random& random) {
 	
 	glm::vec3 colour;
 
 	for (Light * light : scene->lights) {
-		colour += light->apply(hitPos,V,N,material);
+		colour += light->apply(hitPos,V,N,surface,random);
 	}
 	return colour;
 }
@@ -31,34 +36,170 @@ bool traceShadow(Ray ray) {
 	// Holds information about the hit.. Can use this to print debug messages
 	Hit dummy = Hit(); 
 
-	for (Object* object : scene->objects) {		
-		if (object->isHit(ray, dummy)) {
-			return true;
-		}
-	}
-	return false;
+	return scene->topLevel.isHit(ray, dummy);
 }
 
 
 
-/// Recursive Ray Tracer
+/// Ray Tracer
 
 glm::vec3 trace(Ray ray) {
-		
-	glm::vec3 colour(0, 0, 0);			
 
-	Hit currentHit = Hit();
 	Hit closestHit = Hit();	
 
 	// traverse the objects	
-	for (Object* object : scene->objects) {
-		if (object->isHit(ray, currentHit)) {
-			if (currentHit.rayLen < closestHit.rayLen) {
-				closestHit = currentHit;
-			}		
-		}		
+	scene->topLevel.isHit(ray, closestHit);
+
+	return shade(ray, closestHit);
+}
+
+
+void tracePacket(RayPacket& packet) {
+	scene->topLevel.isHit(packet);
+}
+
+
+glm::vec3 shade(Ray ray, Hit closestHit) {
+	// Instead of recursing, the bounces wait on a stack with their throughput (the product of the
+	// weights from the first ray down to them). A hit adds its own colour times its throughput.
+	// The nearest bounce is popped first, so hits are shaded in the order the recursion would.
+	// [shade] never calls itself, so each thread keeps one stack rather than building it per call
+	static thread_local Bounce stack[PATH_STACK_SIZE];
+	int size = 0;
+
+	Bounce curr;
+	curr.ray = ray; // keeps its random numbers, e.g. those of the pixel
+	curr.weight = glm::vec3(1.0f);
+
+	Bounce dropped[MAX_BOUNCES];
+	long long traced = 0;
+	long long cut = 0;
+	glm::vec3 colour(0, 0, 0);
+	while (true) {
+		Bounce* bounces = stack + size;
+		if (size + MAX_BOUNCES > PATH_STACK_SIZE) {
+			bounces = dropped; // too deep, shaded without its bounces
+		}
+
+		int count = 0;
+		colour += curr.weight * shadeHit(curr.ray, closestHit, bounces, count);
+
+		if (bounces != dropped) {
+			int kept = 0;
+			for (int i = 0; i < count; i++) {
+				bounces[i].weight = curr.weight * bounces[i].weight;
+				if (!keepBounce(bounces[i])) {
+					cut += bounces[i].passing ? 0 : 1;
+				}
+				else if (kept++ != i) {
+					bounces[kept - 1] = bounces[i];
+				}
+			}
+			if (kept == 2) {
+				std::swap(bounces[0], bounces[1]); // the first bounce on top
+			}
+			size += kept;
+		}
+
+		if (size == 0) {
+			break;
+		}
+		curr = stack[--size];
+		curr.ray.random = &curr.random;
+		if (!curr.passing) {
+			traced++;
+		}
+
+		closestHit = Hit();
+		scene->topLevel.isHit(curr.ray, closestHit);
+	}
+
+	if (traced || cut) {
+		pathStats.add(traced, cut);
+	}
+	return colour;
+}
+
+
+bool keepBounce(Bounce& bounce) {
+	float throughput = glm::max(bounce.weight.x, glm::max(bounce.weight.y, bounce.weight.z));
+	if (throughput >= scene->cutoff) {
+		return true;
+	}
+	if (!scene->roulette || throughput <= 0.0f) {
+		return false;
 	}
 
+	// Survives with a chance proportional to its throughput, and then counts that much more.
+	// The bounce's own random numbers decide, so the outcome doesn't depend on the trace order.
+	float chance = throughput / scene->cutoff;
+	if (bounce.random.uniform() >= chance) {
+		return false;
+	}
+	bounce.weight /= chance;
+	return true;
+}
+
+
+PathStats pathStats;
+
+// Not flushed yet, by the calling thread
+struct PathCounts {
+	long long traced = 0;
+	long long cut = 0;
+};
+
+static thread_local PathCounts threadCounts;
+
+void PathStats::add(long long tracedRays, long long cutRays) {
+	threadCounts.traced += tracedRays;
+	threadCounts.cut += cutRays;
+}
+
+
+void PathStats::flush() {
+	if (threadCounts.traced || threadCounts.cut) {
+		traced += threadCounts.traced;
+		cut += threadCounts.cut;
+		threadCounts = PathCounts();
+	}
+}
+
+
+void PathStats::print() const {
+	long long total = traced + cut;
+	printf("Secondary rays: %lld traced, %lld cut below the throughput cutoff (%.1f%% saved)\n",
+		(long long)traced, (long long)cut, total ? 100.0 * cut / total : 0.0);
+}
+
+
+// The same [ray] goes on from the hit, e.g. through a negative object. It gets a split of
+// the hit's generator like any bounce: a copy would leave the pixel's generator where it was,
+// and its next sample would draw the same numbers again.
+static void passThrough(const Ray& ray, Bounce bounces[MAX_BOUNCES], int& count) {
+	Bounce& bounce = bounces[count++];
+	bounce.ray = ray;
+	bounce.weight = glm::vec3(1.0f);
+	bounce.random = ray.random->split();
+	bounce.passing = true;
+}
+
+
+// A new [ray] starts at the hit, with its own random numbers
+static void spawn(const Ray& ray, glm::vec3 weight, Bounce bounces[MAX_BOUNCES], int& count) {
+	Bounce& bounce = bounces[count++];
+	bounce.ray = ray;
+	bounce.weight = weight;
+	bounce.random = ray.random->split();
+	bounce.passing = false;
+}
+
+
+glm::vec3 shadeHit(Ray ray, const Hit& closestHit, Bounce bounces[MAX_BOUNCES], int& count) {
+		
+	glm::vec3 colour(0, 0, 0);			
+	count = 0;
+
 	if (closestHit.object != nullptr) {
 	
 		if (ray.debugOn) {
@@ -75,7 +216,8 @@ glm::vec3 trace(Ray ray) {
 			if (ray.debugOn) {
 				printf("Hitting a negative object ...\n\n");
 			}
-			return trace(ray);
+			passThrough(ray, bounces, count);
+			return colour;
 		}
 		else if (obj->isNegative && closestHit.inside && ray.blendingMode) {
 			ray.blendingMode = false;
@@ -85,7 +227,8 @@ glm::vec3 trace(Ray ray) {
 					printf("Leaving a negative object\n\n");
 				}
 				ray.origin = hitPos;
-				return trace(ray);
+				passThrough(ray, bounces, count);
+				return colour;
 			}
 			if (ray.debugOn) {
 				printf("Rendering a inner part of a negative object\n\n");
@@ -98,28 +241,31 @@ glm::vec3 trace(Ray ray) {
 			}
 			ray.origin = hitPos;
 			ray.negativeOn = !ray.negativeOn;
-			return trace(ray);
+			passThrough(ray, bounces, count);
+			return colour;
 		}
 		
 		// Normal trace routine ...
 
+		const Material * material = obj->material;
+		Surface surface = Surface(material);
+
 		if (obj->texture->mode != TextureMode::none) {
-			obj->applyTexture(hitPos);
+			obj->applyTexture(hitPos, closestHit, surface);
 		}
 		
 
 		glm::vec3 V = -ray.direction;
 		glm::vec3 N = closestHit.normal;
-		Material * material = obj->material;
 
 		if (material->transmission == glm::vec3(0,0,0)) { // absorb everything			
-			colour = applyLights(hitPos, V, N, material);
+			colour = applyLights(hitPos, V, N, surface, *ray.random);
 		}
 		else { // absorb some portion of a light			
 
 			if (closestHit.inside) { // don't want to trap light inside...
 				glm::vec3 absorbed = 1.0f - material->transmission;
-				colour = absorbed * applyLights(hitPos, V, N, material);
+				colour = absorbed * applyLights(hitPos, V, N, surface, *ray.random);
 			}				
 
 			if (material->refraction != 0.0) { 				
@@ -135,8 +281,7 @@ glm::vec3 trace(Ray ray) {
 							printf("Refracting AIR --> MATERIAL\n\n");
 						}
 					}
-					ray.origin = ray.origin;
-					colour += material->transmission * trace(ray);					
+					spawn(ray, material->transmission, bounces, count);
 				}
 				else {
 					if (ray.bouncesLeft > 0) {
@@ -145,7 +290,7 @@ glm::vec3 trace(Ray ray) {
 						}
 						ray.reflect(hitPos, N, V);
 						ray.bouncesLeft--;
-						colour += trace(ray);
+						spawn(ray, glm::vec3(1.0f), bounces, count);
 					}
 				}				
 			}	
@@ -154,7 +299,7 @@ glm::vec3 trace(Ray ray) {
 					printf("Simple Transmission ...\n\n");
 				}
 				ray.origin = hitPos;
-				colour += material->transmission * trace(ray);
+				spawn(ray, material->transmission, bounces, count);
 			}
 		}				
 		
@@ -165,7 +310,7 @@ glm::vec3 trace(Ray ray) {
 				}
 				ray.reflect(hitPos, N, V);
 				ray.bouncesLeft--;
-				colour += material->reflection * trace(ray);
+				spawn(ray, material->reflection, bounces, count);
 			}
 		}		
 	}
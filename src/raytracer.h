@@ -3,13 +3,66 @@
 
 #include "utility/scene_adapter.h"
 #include "ray.h"
+#include "utility/random.h"
 
-// loads the scene
-void loadScene(char* fn, float& fov, bool& antialiasing);
+#include <atomic>	// std::atomic
 
-// This function is called recursively, returns a final [colour].
+// The scene being rendered, set by [loadScene]
+extern SceneAdapter* scene;
+
+// loads the scene, on the threads of [scheduler] if given
+void loadScene(char* fn, float& fov, bool& antialiasing, unsigned& seed, int& bounces, Scheduler* scheduler = nullptr);
+
+// Returns a final [colour], following the reflections, refractions etc. of the [ray]
 glm::vec3 trace(Ray ray);
 
+// Finds the closest hit of every ray of the [packet], e.g. the primary rays of a block of pixels
+void tracePacket(RayPacket& packet);
+
+// The [colour] seen along a [ray] that found [closestHit], the second half of [trace]
+glm::vec3 shade(Ray ray, Hit closestHit);
+
+
+class Bounce {
+	/// A ray spawned at a hit: the same ray going on (through a negative object), or a
+	/// reflected, refracted or transmitted one. Its colour counts [weight] times in the colour of the hit.
+public:
+	Ray ray;
+	glm::vec3 weight;
+	Random random; // for [ray], split from the hit's, so bounces can be traced in any order
+	bool passing = false; // the same ray going on, not counted as a secondary ray
+};
+
+// Per hit: a transmitted (or refracted) ray and a reflected one
+const int MAX_BOUNCES = 2;
+
+// Bounces waiting in [shade] at most. A path that branches deeper (e.g. a ray trapped between
+// glass & mirrors) loses its deepest bounces instead of overflowing the stack of a worker thread.
+const int PATH_STACK_SIZE = 64;
+
+// False if the [bounce], whose [weight] is its throughput, isn't worth tracing: below the scene's
+// cutoff it is dropped, or with Russian roulette it survives by chance and its weight is scaled up.
+bool keepBounce(Bounce& bounce);
+
+// The colour of the [closestHit] itself, the rays it spawns are written to [bounces] instead of traced.
+// [shade] = this + the [weight] times the colour of each bounce.
+glm::vec3 shadeHit(Ray ray, const Hit& closestHit, Bounce bounces[MAX_BOUNCES], int& count);
+
+class PathStats {
+	/// Secondary rays of the renders so far, over all threads. [add] counts on the calling
+	/// thread only, and [flush] adds that to the totals once in a while (e.g. after a tile),
+	/// so tracing doesn't make every thread write to the same counters.
+public:
+	std::atomic<long long> traced{ 0 };
+	std::atomic<long long> cut{ 0 };	// by [keepBounce]
+
+	void add(long long traced, long long cut);
+	void flush();
+	void print() const;
+};
+
+extern PathStats pathStats;
+
 // Similar to trace, except it finds the first hit, not the closest one
 bool traceShadow(Ray ray);
 
@@ -0,0 +1,274 @@
+#include "renderer.h"
+#include "wavefront.h"
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "utility/stb_image_write.h" // to save rendered images, https://github.com/nothings/stb
+
+#include <algorithm>	// std::min
+#include <cmath>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846264338327950288
+#endif
+
+
+/// Camera
+
+glm::vec3 Camera::s(int x, int y, float offsetX, float offsetY) {
+	float aspect_ratio = (float)width / height;
+	float h = d * (float)tan((M_PI * fov) / 180.0 / 2.0);
+	float w = h * aspect_ratio;
+
+	float top = h;
+	float bottom = -h;
+	float left = -w;
+	float right = w;
+
+	float u = left + (right - left) * (x + 0.5f + offsetX) / width;
+	float v = bottom + (top - bottom) * (y + 0.5f + offsetY) / height;
+
+	return glm::vec3(u, v, -d);
+}
+
+
+Ray Camera::primaryRay(int x, int y, float offsetX, float offsetY) {
+	Ray ray = Ray();
+	ray.origin = eye;
+	ray.bouncesLeft = bounces;
+	ray.setDirection(normalize(s(x, y, offsetX, offsetY) - eye));
+	return ray;
+}
+
+
+Random Camera::pixelRandom(int x, int y) {
+	return Random(seed, (uint64_t)y * width + x);
+}
+
+
+glm::vec3 Camera::tracePixel(int x, int y) {
+	Random random = pixelRandom(x, y);
+
+	if (!antialiasing) {
+		Ray ray = primaryRay(x, y);
+		ray.random = &random;
+		return trace(ray);
+	}
+
+	float offset = 0.25;
+	float offsets[4][2] = { { +offset, +offset }, { +offset, -offset }, { -offset, +offset }, { -offset, -offset } };
+
+	glm::vec3 out;
+	for (int i = 0; i < 4; i++) {
+		Ray ray = primaryRay(x, y, offsets[i][0], offsets[i][1]);
+		ray.random = &random;
+		out += trace(ray);
+	}
+	return out / 4.0f;
+}
+
+
+void Camera::traceBlock(int x, int y, int endX, int endY, glm::vec3* colours) {
+	int width = endX - x;
+	int count = width * (endY - y);
+
+	// Each pixel keeps its own random sequence through its samples, as in [tracePixel]
+	Random randoms[PACKET_RAYS];
+	for (int i = 0; i < count; i++) {
+		randoms[i] = pixelRandom(x + i % width, y + i / width);
+		colours[i] = glm::vec3(0.0f);
+	}
+
+	float offset = 0.25;
+	float offsets[4][2] = { { +offset, +offset }, { +offset, -offset }, { -offset, +offset }, { -offset, -offset } };
+	int samples = antialiasing ? 4 : 1;
+
+	RayPacket packet;
+	for (int s = 0; s < samples; s++) {
+		float offsetX = antialiasing ? offsets[s][0] : 0.0f;
+		float offsetY = antialiasing ? offsets[s][1] : 0.0f;
+
+		packet.clear();
+		for (int i = 0; i < count; i++) {
+			packet.add(primaryRay(x + i % width, y + i / width, offsetX, offsetY));
+		}
+		packet.close();
+		tracePacket(packet);
+
+		for (int i = 0; i < count; i++) {
+			Ray ray = packet.added(i);
+			ray.random = &randoms[i];
+			colours[i] += shade(ray, packet.hits[i]);
+		}
+	}
+
+	if (antialiasing) {
+		for (int i = 0; i < count; i++) {
+			colours[i] /= 4.0f;
+		}
+	}
+}
+
+
+void Camera::traceWavefront(int x, int y, int endX, int endY, glm::vec3* colours) {
+	int width = endX - x;
+	int count = width * (endY - y);
+
+	std::vector<Random> randoms(count);
+	for (int i = 0; i < count; i++) {
+		randoms[i] = pixelRandom(x + i % width, y + i / width);
+		colours[i] = glm::vec3(0.0f);
+	}
+
+	float offset = 0.25;
+	float offsets[4][2] = { { +offset, +offset }, { +offset, -offset }, { -offset, +offset }, { -offset, -offset } };
+	int samples = antialiasing ? 4 : 1;
+
+	// One wave per sample, so the samples of a pixel still draw from its random numbers in turn
+	Wavefront wavefront;
+	std::vector<int> pixels; // of each path
+	RayPacket packet;
+
+	for (int s = 0; s < samples; s++) {
+		float offsetX = antialiasing ? offsets[s][0] : 0.0f;
+		float offsetY = antialiasing ? offsets[s][1] : 0.0f;
+		wavefront.clear();
+		pixels.clear();
+
+		for (int blockY = y; blockY < endY; blockY += PACKET_SIDE) {
+			for (int blockX = x; blockX < endX; blockX += PACKET_SIDE) {
+				int blockEndX = std::min(blockX + PACKET_SIDE, endX);
+				int blockEndY = std::min(blockY + PACKET_SIDE, endY);
+
+				packet.clear();
+				for (int py = blockY; py < blockEndY; py++) {
+					for (int px = blockX; px < blockEndX; px++) {
+						packet.add(primaryRay(px, py, offsetX, offsetY));
+						pixels.push_back((py - y) * width + (px - x));
+					}
+				}
+				packet.close();
+				if (packets) {
+					tracePacket(packet);
+				}
+
+				for (int i = 0; i < packet.count; i++) {
+					Ray ray = packet.added(i);
+					ray.random = &randoms[pixels[pixels.size() - packet.count + i]];
+					if (!packets) {
+						packet.hits[i] = Hit();
+						scene->topLevel.isHit(ray, packet.hits[i]);
+					}
+					wavefront.add(ray, packet.hits[i]);
+				}
+			}
+		}
+
+		wavefront.run();
+		for (size_t path = 0; path < pixels.size(); path++) {
+			colours[pixels[path]] += wavefront.colour((int)path);
+		}
+	}
+
+	if (antialiasing) {
+		for (int i = 0; i < count; i++) {
+			colours[i] /= 4.0f;
+		}
+	}
+}
+
+
+/// Framebuffer
+
+Framebuffer::Framebuffer(int width, int height) :
+	width(width), height(height), pixels(width * height) {
+}
+
+
+glm::vec3& Framebuffer::at(int x, int y) {
+	return pixels[y * width + x];
+}
+
+
+bool Framebuffer::savePNG(const char* filename) {
+	std::vector<unsigned char> data(width * height * 3); // 3 components (R, G, B)
+
+	// png rows go top to bottom, so flipping vertically while converting
+	for (int y = 0; y < height; y++) {
+		unsigned char* row = &data[(height - y - 1) * width * 3];
+		for (int x = 0; x < width; x++) {
+			glm::vec3 colour = glm::clamp(at(x, y), 0.0f, 1.0f);
+			for (int i = 0; i < 3; i++) {
+				row[x * 3 + i] = (unsigned char)(colour[i] * 255.0f + 0.5f);
+			}
+		}
+	}
+
+	return stbi_write_png(filename, width, height, 3, data.data(), 0) != 0;
+}
+
+
+/// Render loop
+
+// Traces the pixels [x, endX) x [y, endY) of the [framebuffer]
+static void traceRegion(Camera& camera, Framebuffer& framebuffer, int x, int y, int endX, int endY) {
+	if (camera.wavefront) {
+		int width = endX - x;
+		std::vector<glm::vec3> colours(width * (endY - y));
+		camera.traceWavefront(x, y, endX, endY, colours.data());
+		for (int py = y; py < endY; py++) {
+			for (int px = x; px < endX; px++) {
+				framebuffer.at(px, py) = colours[(py - y) * width + (px - x)];
+			}
+		}
+		return;
+	}
+
+	if (!camera.packets) {
+		for (int py = y; py < endY; py++) {
+			for (int px = x; px < endX; px++) {
+				framebuffer.at(px, py) = camera.tracePixel(px, py);
+			}
+		}
+		return;
+	}
+
+	glm::vec3 colours[PACKET_RAYS];
+	for (int blockY = y; blockY < endY; blockY += PACKET_SIDE) {
+		for (int blockX = x; blockX < endX; blockX += PACKET_SIDE) {
+			int blockEndX = std::min(blockX + PACKET_SIDE, endX);
+			int blockEndY = std::min(blockY + PACKET_SIDE, endY);
+			camera.traceBlock(blockX, blockY, blockEndX, blockEndY, colours);
+
+			int width = blockEndX - blockX;
+			for (int py = blockY; py < blockEndY; py++) {
+				for (int px = blockX; px < blockEndX; px++) {
+					framebuffer.at(px, py) = colours[(py - blockY) * width + (px - blockX)];
+				}
+			}
+		}
+	}
+}
+
+
+void render(Camera& camera, Framebuffer& framebuffer) {
+	traceRegion(camera, framebuffer, 0, 0, framebuffer.width, framebuffer.height);
+	pathStats.flush();
+}
+
+
+void renderTiles(Camera& camera, Framebuffer& framebuffer, Scheduler& scheduler, int tileSize) {
+	TaskGroup tiles;
+
+	for (int tileY = 0; tileY < framebuffer.height; tileY += tileSize) {
+		for (int tileX = 0; tileX < framebuffer.width; tileX += tileSize) {
+			scheduler.spawn(tiles, [&camera, &framebuffer, tileX, tileY, tileSize]() {
+				int endX = std::min(tileX + tileSize, framebuffer.width);
+				int endY = std::min(tileY + tileSize, framebuffer.height);
+				traceRegion(camera, framebuffer, tileX, tileY, endX, endY);
+				pathStats.flush(); // once per tile, not per ray
+			});
+		}
+	}
+
+	scheduler.wait(tiles);
+}
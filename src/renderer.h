@@ -0,0 +1,70 @@
+#ifndef renderer_h // include guard
+#define renderer_h
+
+#include "raytracer.h"
+#include "utility/random.h"
+#include "utility/scheduler.h"
+
+#include <glm/glm.hpp>  // glm
+#include <vector>		// std::vector
+
+
+class Camera {
+	/// Pinhole camera placed at the [eye] and looking down the -Z axis.
+	/// It generates primary rays for a [width] x [height] image.
+public:
+	glm::vec3 eye;
+	float fov = 60.0f;
+	float d = 1.0f;
+	bool antialiasing = false;
+	bool packets = true; // primary rays traced as packets (same image, faster)
+	bool wavefront = false; // secondary rays traced breadth first, see [Wavefront] (same image)
+	unsigned seed = 0;
+	int bounces = 5; // reflections per primary ray
+	int width = 640;
+	int height = 640;
+
+	// Point on the image plane that belongs to pixel (x, y), where y = 0 is the bottom row
+	glm::vec3 s(int x, int y, float offsetX = 0.0f, float offsetY = 0.0f);
+
+	Ray primaryRay(int x, int y, float offsetX = 0.0f, float offsetY = 0.0f);
+
+	// Random numbers of pixel (x, y), the same sequence every time the pixel is traced
+	Random pixelRandom(int x, int y);
+
+	// Returns a final [colour] of a pixel, using SSAA x4 if [antialiasing] is on
+	glm::vec3 tracePixel(int x, int y);
+
+	// Same as [tracePixel] for the pixels [x, endX) x [y, endY), at most PACKET_RAYS of them.
+	// The primary rays are traced together as a packet, the rest of each path one ray at a time.
+	// [colours] are stored row by row.
+	void traceBlock(int x, int y, int endX, int endY, glm::vec3* colours);
+
+	// Same as [tracePixel] for the pixels [x, endX) x [y, endY), every path at once with a [Wavefront]
+	void traceWavefront(int x, int y, int endX, int endY, glm::vec3* colours);
+};
+
+
+class Framebuffer {
+	/// In-memory image, rows are stored bottom to top (same as the OpenGL viewport)
+public:
+	int width;
+	int height;
+	std::vector<glm::vec3> pixels;
+
+	Framebuffer(int width, int height);
+
+	glm::vec3& at(int x, int y);
+	bool savePNG(const char* filename);
+};
+
+
+// Traces every pixel of the [framebuffer] on the calling thread
+void render(Camera& camera, Framebuffer& framebuffer);
+
+// Splits the [framebuffer] into [tileSize] x [tileSize] tiles and traces them on the [scheduler].
+// Idle workers steal tiles from busy ones, so expensive regions (e.g. area lights) don't stall the frame.
+void renderTiles(Camera& camera, Framebuffer& framebuffer, Scheduler& scheduler, int tileSize = 16);
+
+
+#endif renderer_h
@@ -0,0 +1,104 @@
+#include "arena.h"
+
+#include <stdint.h>	// uintptr_t
+#include <stdlib.h>	// malloc, free
+
+#ifdef __linux__
+#include <sys/mman.h>	// madvise
+#endif
+
+const size_t HUGE_PAGE_SIZE = 2 << 20;
+
+bool Arena::hugePages = false;
+
+
+static uintptr_t alignUp(uintptr_t address, size_t alignment) {
+	return (address + alignment - 1) & ~(uintptr_t)(alignment - 1);
+}
+
+
+Arena::Arena(size_t blockSize) : blockSize(blockSize) {
+}
+
+
+Arena::~Arena() {
+	clear();
+}
+
+
+void* Arena::allocate(size_t size, size_t alignment) {
+	uintptr_t address = alignUp((uintptr_t)current, alignment);
+	if (current == nullptr || address + size > (uintptr_t)end) {
+		// What is left of the current block is given up, it is small compared to a block
+		addBlock(size + alignment);
+		address = alignUp((uintptr_t)current, alignment);
+	}
+
+	used += address + size - (uintptr_t)current;
+	current = (char*)(address + size);
+	return (void*)address;
+}
+
+
+void Arena::addBlock(size_t minSize) {
+	Block block;
+	block.size = minSize > blockSize ? minSize : blockSize;
+	block.data = nullptr;
+
+#ifdef __linux__
+	if (hugePages) {
+		block.size = alignUp(block.size, HUGE_PAGE_SIZE);
+		void* data = nullptr;
+		if (posix_memalign(&data, HUGE_PAGE_SIZE, block.size) == 0) {
+			madvise(data, block.size, MADV_HUGEPAGE); // only a hint, fine if it fails
+			block.data = (char*)data;
+		}
+	}
+#endif
+
+	if (block.data == nullptr) {
+		block.data = (char*)malloc(block.size);
+		if (block.data == nullptr) {
+			throw std::bad_alloc();
+		}
+	}
+
+	blocks.push_back(block);
+	current = block.data;
+	end = block.data + block.size;
+}
+
+
+void Arena::clear() {
+	for (size_t i = destructors.size(); i-- > 0;) {
+		destructors[i].destroy(destructors[i].object);
+	}
+	destructors.clear();
+
+	for (Block& block : blocks) {
+		free(block.data);
+	}
+	blocks.clear();
+	current = nullptr;
+	end = nullptr;
+	used = 0;
+}
+
+
+size_t Arena::bytesUsed() const {
+	return used;
+}
+
+
+size_t Arena::bytesReserved() const {
+	size_t total = 0;
+	for (const Block& block : blocks) {
+		total += block.size;
+	}
+	return total;
+}
+
+
+int Arena::blockCount() const {
+	return (int)blocks.size();
+}
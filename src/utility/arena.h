@@ -0,0 +1,68 @@
+#ifndef arena_h // include guard
+#define arena_h
+
+#include <new>			// placement new
+#include <stddef.h>		// size_t
+#include <type_traits>	// std::is_trivially_destructible
+#include <utility>		// std::forward
+#include <vector>		// std::vector
+
+
+class Arena {
+	/// Bump allocator owning the objects of one scene.
+	///
+	/// Memory comes from large blocks and is handed out by moving a pointer, so objects loaded one
+	/// after the other sit next to each other and allocating costs a few instructions. Nothing is
+	/// freed on its own: [clear] (or the destructor) releases everything at once, after running
+	/// the destructors of the objects that have one (e.g. the vectors of a mesh), newest first.
+public:
+	explicit Arena(size_t blockSize = 64 << 10);
+	~Arena();
+
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+
+	// Blocks allocated from now on are aligned to 2 MB and marked for transparent huge pages
+	// (Linux only), which saves TLB misses when a large scene is traced
+	static bool hugePages;
+
+	void* allocate(size_t size, size_t alignment);
+
+	template <typename T, typename... Args>
+	T* make(Args&&... args) {
+		T* object = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+		if (!std::is_trivially_destructible<T>::value) {
+			destructors.push_back(Destructor{ [](void* p) { static_cast<T*>(p)->~T(); }, object });
+		}
+		return object;
+	}
+
+	void clear();
+
+	size_t bytesUsed() const;		// by the objects, including alignment
+	size_t bytesReserved() const;	// by the blocks
+	int blockCount() const;
+
+private:
+	struct Block {
+		char* data;
+		size_t size;
+	};
+
+	struct Destructor {
+		void (*destroy)(void*);
+		void* object;
+	};
+
+	size_t blockSize;
+	std::vector<Block> blocks;
+	std::vector<Destructor> destructors;
+	char* current = nullptr;
+	char* end = nullptr;
+	size_t used = 0;
+
+	void addBlock(size_t minSize);
+};
+
+
+#endif arena_h
@@ -0,0 +1,27 @@
+#ifndef array_view_h // include guard
+#define array_view_h
+
+#include <stddef.h>	// size_t
+#include <vector>	// std::vector
+
+
+template <typename T>
+class ArrayView {
+	/// Read-only window on an array that lives elsewhere: a vector of the same object,
+	/// or a file mapped into memory. It never owns or copies what it shows.
+public:
+	const T* data = nullptr;
+	size_t size = 0;
+
+	ArrayView() = default;
+	ArrayView(const T* data, size_t size) : data(data), size(size) {}
+	ArrayView(const std::vector<T>& vector) : data(vector.data()), size(vector.size()) {}
+
+	const T& operator[](size_t i) const { return data[i]; }
+	const T* begin() const { return data; }
+	const T* end() const { return data + size; }
+	bool empty() const { return size == 0; }
+};
+
+
+#endif array_view_h
@@ -0,0 +1,104 @@
+#include "mapped_file.h"
+
+#include <fstream>	// std::ifstream
+#include <iterator>	// std::istreambuf_iterator
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>		// open
+#include <sys/mman.h>	// mmap
+#include <sys/stat.h>	// fstat
+#include <unistd.h>		// close
+#endif
+
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+
+bool MappedFile::open(const std::string& path, bool sequential) {
+	close();
+
+#ifdef _WIN32
+	HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (handle != INVALID_HANDLE_VALUE) {
+		LARGE_INTEGER fileSize;
+		if (GetFileSizeEx(handle, &fileSize) && fileSize.QuadPart > 0) {
+			HANDLE view = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+			if (view != NULL) {
+				begin = (const char*)MapViewOfFile(view, FILE_MAP_READ, 0, 0, 0);
+				if (begin != nullptr) {
+					file = handle;
+					mapping = view;
+					length = (size_t)fileSize.QuadPart;
+					mapped = true;
+					return true;
+				}
+				CloseHandle(view);
+			}
+		}
+		CloseHandle(handle);
+	}
+#else
+	int descriptor = ::open(path.c_str(), O_RDONLY);
+	if (descriptor >= 0) {
+		struct stat status;
+		if (fstat(descriptor, &status) == 0 && status.st_size > 0) {
+			void* view = mmap(nullptr, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+			if (view != MAP_FAILED) {
+				if (sequential) {
+					madvise(view, (size_t)status.st_size, MADV_SEQUENTIAL);
+				}
+				::close(descriptor); // the mapping stays valid
+				begin = (const char*)view;
+				length = (size_t)status.st_size;
+				mapped = true;
+				return true;
+			}
+		}
+		::close(descriptor);
+	}
+#endif
+
+	// Not mappable (e.g. empty), read it instead
+	std::ifstream in(path, std::ios::binary);
+	if (!in.is_open()) {
+		return false;
+	}
+	buffer.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+	begin = buffer.data();
+	length = buffer.size();
+	return true;
+}
+
+
+void MappedFile::close() {
+	if (mapped) {
+#ifdef _WIN32
+		UnmapViewOfFile(begin);
+		CloseHandle(mapping);
+		CloseHandle(file);
+		mapping = nullptr;
+		file = nullptr;
+#else
+		munmap((void*)begin, length);
+#endif
+	}
+	buffer.clear();
+	begin = nullptr;
+	length = 0;
+	mapped = false;
+}
+
+
+const char* MappedFile::data() const {
+	return begin;
+}
+
+
+size_t MappedFile::size() const {
+	return length;
+}
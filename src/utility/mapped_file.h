@@ -0,0 +1,42 @@
+#ifndef mapped_file_h // include guard
+#define mapped_file_h
+
+#include <stddef.h>	// size_t
+#include <string>	// std::string
+#include <vector>	// std::vector
+
+
+class MappedFile {
+	/// Read-only view of a whole file.
+	///
+	/// The file is mapped into memory (mmap, or a file mapping on Windows), so nothing is
+	/// copied up front and the OS reads the pages as they are touched. Where mapping fails
+	/// the file is read into a buffer instead, which looks the same to the caller.
+public:
+	MappedFile() = default;
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// false if the file can't be read. [sequential] tells the OS it will be read once, front
+	// to back; leave it off for data that is looked up at random (e.g. a mapped mesh).
+	bool open(const std::string& path, bool sequential = true);
+	void close();
+
+	const char* data() const;
+	size_t size() const;
+
+private:
+	const char* begin = nullptr;
+	size_t length = 0;
+	bool mapped = false;
+	std::vector<char> buffer;
+#ifdef _WIN32
+	void* file = nullptr;
+	void* mapping = nullptr;
+#endif
+};
+
+
+#endif mapped_file_h
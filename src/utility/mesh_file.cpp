@@ -0,0 +1,176 @@
+#include "mesh_file.h"
+
+#include <algorithm>	// std::min, std::max, std::fill, std::copy
+#include <fstream>	// std::ofstream
+#include <string.h>	// memcpy, memcmp
+#include <vector>	// std::vector
+
+
+static const char MESH_FILE_MAGIC[8] = { 'R', 'T', 'M', 'E', 'S', 'H', 0, 0 };
+
+
+static uint64_t align(uint64_t offset) {
+	return (offset + MESH_FILE_ALIGNMENT - 1) / MESH_FILE_ALIGNMENT * MESH_FILE_ALIGNMENT;
+}
+
+
+// A file may come from anywhere, and its indices are used without bounds checks when tracing:
+// every one must point inside its array, and the tree must fit the traversal stack.
+static bool isValid(ArrayView<uint32_t> indices, size_t vertexCount, ArrayView<FlatNode> nodes, size_t triangleCount) {
+	for (uint32_t index : indices) {
+		if (index >= vertexCount) {
+			return false;
+		}
+	}
+
+	// Children come after their parent, so there is no cycle and one pass in order sees every
+	// parent first. [waiting] is the most siblings left on the stack when a node is popped.
+	std::vector<uint32_t> waiting(nodes.size, 0);
+	for (size_t i = 0; i < nodes.size; i++) {
+		const FlatNode& node = nodes[i];
+		uint64_t end = (uint64_t)node.first + node.count;
+		if (node.isLeaf) {
+			if (end > triangleCount) {
+				return false;
+			}
+			continue;
+		}
+		if (node.first <= i || end > nodes.size || waiting[i] + node.count > (uint64_t)FLAT_STACK_SIZE) {
+			return false;
+		}
+		for (uint64_t c = node.first; c < end; c++) {
+			waiting[c] = std::max(waiting[c], waiting[i] + node.count - 1);
+		}
+	}
+	return true;
+}
+
+
+bool saveMesh(const std::string& path, const Mesh& mesh, ArrayView<FlatNode> nodes, std::string& error) {
+	std::ofstream out(path, std::ios::binary);
+	if (!out.is_open()) {
+		error = "can't write " + path;
+		return false;
+	}
+	writeMesh(out, mesh, nodes);
+	if (!out.good()) {
+		error = "can't write " + path;
+		return false;
+	}
+	return true;
+}
+
+
+uint64_t writeMesh(std::ostream& out, const Mesh& mesh, ArrayView<FlatNode> nodes) {
+	MeshFileHeader header = MeshFileHeader();
+	memcpy(header.magic, MESH_FILE_MAGIC, sizeof(header.magic));
+	header.version = MESH_FILE_VERSION;
+	header.triangleCount = mesh.triangleCount();
+	header.vertexCount = (uint32_t)mesh.vertexView.size;
+	header.nodeCount = (uint32_t)nodes.size;
+	// A whole number of cache lines per array, so each of them starts on one too
+	uint64_t floatsPerLine = MESH_FILE_ALIGNMENT / sizeof(float);
+	header.coordStride = (uint32_t)((header.triangleCount + MAX_TRIANGLE_LANES - 1 + floatsPerLine - 1) / floatsPerLine * floatsPerLine);
+	for (int axis = 0; axis < 3; axis++) {
+		header.min[axis] = mesh.min[axis];
+		header.max[axis] = mesh.max[axis];
+	}
+
+	header.vertexOffset = align(sizeof(MeshFileHeader));
+	header.indexOffset = align(header.vertexOffset + (uint64_t)header.vertexCount * sizeof(glm::vec3));
+	header.coordOffset = align(header.indexOffset + 3 * (uint64_t)header.triangleCount * sizeof(uint32_t));
+	header.nodeOffset = align(header.coordOffset + 9 * (uint64_t)header.coordStride * sizeof(float));
+	header.fileSize = header.nodeOffset + (uint64_t)header.nodeCount * sizeof(FlatNode);
+
+	uint64_t written = 0;
+	auto write = [&](uint64_t offset, const void* data, uint64_t size) {
+		static const char zeros[MESH_FILE_ALIGNMENT] = {};
+		while (written < offset) { // padding up to the array
+			uint64_t gap = std::min<uint64_t>(offset - written, sizeof(zeros));
+			out.write(zeros, (std::streamsize)gap);
+			written += gap;
+		}
+		out.write((const char*)data, (std::streamsize)size);
+		written += size;
+	};
+
+	write(0, &header, sizeof(header));
+	write(header.vertexOffset, mesh.vertexView.data, mesh.vertexView.size * sizeof(glm::vec3));
+	write(header.indexOffset, mesh.indexView.data, mesh.indexView.size * sizeof(uint32_t));
+
+	std::vector<float> coords(header.coordStride);
+	for (int k = 0; k < 3; k++) {
+		for (int axis = 0; axis < 3; axis++) {
+			// Padded with zeros, like [Mesh::pack] does
+			std::fill(coords.begin(), coords.end(), 0.0f);
+			std::copy(mesh.coords[k][axis].begin(), mesh.coords[k][axis].begin() + header.triangleCount, coords.begin());
+			write(header.coordOffset + (3 * k + axis) * (uint64_t)header.coordStride * sizeof(float),
+				coords.data(), coords.size() * sizeof(float));
+		}
+	}
+
+	write(header.nodeOffset, nodes.data, nodes.size * sizeof(FlatNode));
+	return written;
+}
+
+
+bool loadMesh(const MappedFile& file, Mesh& mesh, ArrayView<FlatNode>& nodes, std::string& error) {
+	return loadMesh(file.data(), file.size(), mesh, nodes, error);
+}
+
+
+bool loadMesh(const char* data, uint64_t size, Mesh& mesh, ArrayView<FlatNode>& nodes, std::string& error) {
+	MeshFileHeader header;
+	if (size < sizeof(header)) {
+		error = "not a mesh file";
+		return false;
+	}
+	memcpy(&header, data, sizeof(header));
+
+	if (memcmp(header.magic, MESH_FILE_MAGIC, sizeof(header.magic)) != 0) {
+		error = "not a mesh file";
+		return false;
+	}
+	if (header.version != MESH_FILE_VERSION) {
+		error = "mesh file version " + std::to_string(header.version) + ", expected " + std::to_string(MESH_FILE_VERSION)
+			+ ", convert the model again";
+		return false;
+	}
+
+	uint64_t fileSize = size;
+	auto fits = [&](uint64_t offset, uint64_t size) {
+		return offset % MESH_FILE_ALIGNMENT == 0 && offset <= fileSize && size <= fileSize - offset;
+	};
+	if (header.fileSize != fileSize
+		|| header.triangleCount == 0
+		|| (uint64_t)header.coordStride < (uint64_t)header.triangleCount + MAX_TRIANGLE_LANES - 1
+		|| !fits(header.vertexOffset, (uint64_t)header.vertexCount * sizeof(glm::vec3))
+		|| !fits(header.indexOffset, 3 * (uint64_t)header.triangleCount * sizeof(uint32_t))
+		|| !fits(header.coordOffset, 9 * (uint64_t)header.coordStride * sizeof(float))
+		|| !fits(header.nodeOffset, (uint64_t)header.nodeCount * sizeof(FlatNode))) {
+		error = "truncated or damaged mesh file";
+		return false;
+	}
+
+	ArrayView<uint32_t> indices((const uint32_t*)(data + header.indexOffset), 3 * (size_t)header.triangleCount);
+	ArrayView<FlatNode> tree((const FlatNode*)(data + header.nodeOffset), header.nodeCount);
+	if (!isValid(indices, header.vertexCount, tree, header.triangleCount)) {
+		error = "damaged mesh file, an index or a node is out of range";
+		return false;
+	}
+
+	mesh.vertexView = ArrayView<glm::vec3>((const glm::vec3*)(data + header.vertexOffset), header.vertexCount);
+	mesh.indexView = indices;
+	const float* coords = (const float*)(data + header.coordOffset);
+	for (int k = 0; k < 3; k++) {
+		for (int axis = 0; axis < 3; axis++) {
+			mesh.coords[k][axis] = ArrayView<float>(coords + (3 * k + axis) * (size_t)header.coordStride, header.coordStride);
+		}
+	}
+	nodes = tree;
+
+	mesh.min = glm::vec3(header.min[0], header.min[1], header.min[2]);
+	mesh.max = glm::vec3(header.max[0], header.max[1], header.max[2]);
+	mesh.center = (mesh.min + mesh.max) / 2.0f;
+	return true;
+}
@@ -0,0 +1,60 @@
+#ifndef mesh_file_h // include guard
+#define mesh_file_h
+
+#include "mapped_file.h"
+#include "array_view.h"
+#include "../models/model.h"
+#include "../acceleration/traversal.h"
+
+#include <ostream>	// std::ostream
+#include <stdint.h>	// uint32_t, uint64_t
+#include <string>	// std::string
+
+
+// Bumped whenever the layout below or of [FlatNode] changes
+const uint32_t MESH_FILE_VERSION = 1;
+
+// Every array starts on a cache line
+const uint64_t MESH_FILE_ALIGNMENT = 64;
+
+
+struct MeshFileHeader {
+	/// First bytes of a .mesh file. The arrays follow at the given offsets, in the same layout
+	/// as in memory (little endian, 32 bit floats & indices), so they are used without a copy.
+	char magic[8];				// "RTMESH\0\0"
+	uint32_t version;
+	uint32_t triangleCount;
+	uint32_t vertexCount;
+	uint32_t nodeCount;			// 0 if no tree was stored
+	uint32_t coordStride;		// floats per packed array, padding included
+	uint32_t reserved;
+	float min[3];				// bounds of the vertices
+	float max[3];
+	uint64_t vertexOffset;		// vertexCount glm::vec3
+	uint64_t indexOffset;		// 3 * triangleCount uint32_t
+	uint64_t coordOffset;		// the 9 packed arrays of [Mesh::coords], each coordStride floats
+	uint64_t nodeOffset;		// nodeCount FlatNode
+	uint64_t fileSize;
+};
+
+
+/// Writes the packed triangles of [mesh] and the flattened tree over them ([nodes] may be empty).
+/// [pack] must have run, and the triangles must be in the order the leaves of [nodes] expect.
+bool saveMesh(const std::string& path, const Mesh& mesh, ArrayView<FlatNode> nodes, std::string& error);
+
+/// The same, at the current position of [out], which should be a multiple of MESH_FILE_ALIGNMENT
+/// from the start of the mapping it will be read from. Returns the number of bytes written.
+uint64_t writeMesh(std::ostream& out, const Mesh& mesh, ArrayView<FlatNode> nodes);
+
+/// Points the views of [mesh] and [nodes] into [file], which must stay open as long as they are used.
+/// The header is checked against the file size, and the indices & nodes against the arrays they
+/// point into and the traversal stack, so a damaged file is rejected instead of read out of bounds.
+/// The coordinates aren't read: their pages are loaded as rays touch them. The bounds & center
+/// of [mesh] are set too.
+bool loadMesh(const MappedFile& file, Mesh& mesh, ArrayView<FlatNode>& nodes, std::string& error);
+
+/// The same for a mesh written by [writeMesh] at [data] (aligned on MESH_FILE_ALIGNMENT), [size] bytes long
+bool loadMesh(const char* data, uint64_t size, Mesh& mesh, ArrayView<FlatNode>& nodes, std::string& error);
+
+
+#endif mesh_file_h
@@ -0,0 +1,329 @@
+#include "obj_loader.h"
+#include "mapped_file.h"
+
+#include <algorithm>	// std::min, std::max
+#include <stdlib.h>		// strtof
+#include <string.h>		// memcpy
+#include <functional>	// std::ref
+#include <thread>		// std::thread
+
+
+// Below this size a single thread is faster than starting more
+const size_t OBJ_CHUNK_SIZE = 4 << 20;
+
+
+static bool isDigit(char c) {
+	return c >= '0' && c <= '9';
+}
+
+
+static bool isBlank(char c) {
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+
+static void skipBlanks(const char*& p, const char* end) {
+	while (p < end && isBlank(*p)) {
+		p++;
+	}
+}
+
+
+// Reads a decimal number the way strtof does ("-1.5e-3", "2", ".5") and moves [p] past it.
+// Returns false, leaving [p] alone, if there is no number.
+static bool parseFloat(const char*& p, const char* end, float& value) {
+	const char* start = p;
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) {
+		negative = *p == '-';
+		p++;
+	}
+
+	// Up to 19 significant digits fit in the mantissa, the power of ten keeps track of the rest
+	uint64_t mantissa = 0;
+	int digits = 0;
+	int exponent = 0;
+	bool any = false;
+	for (; p < end && isDigit(*p); p++, any = true) {
+		if (digits < 19) {
+			mantissa = mantissa * 10 + (*p - '0');
+			digits += mantissa != 0;
+		}
+		else {
+			exponent++;
+		}
+	}
+	if (p < end && *p == '.') {
+		p++;
+		for (; p < end && isDigit(*p); p++, any = true) {
+			if (digits < 19) {
+				mantissa = mantissa * 10 + (*p - '0');
+				digits += mantissa != 0;
+				exponent--;
+			}
+		}
+	}
+	if (!any) {
+		p = start;
+		return false;
+	}
+
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		const char* e = p++;
+		bool negativeExponent = false;
+		if (p < end && (*p == '-' || *p == '+')) {
+			negativeExponent = *p == '-';
+			p++;
+		}
+		if (p < end && isDigit(*p)) {
+			int power = 0;
+			for (; p < end && isDigit(*p); p++) {
+				power = std::min(power * 10 + (*p - '0'), 100000);
+			}
+			exponent += negativeExponent ? -power : power;
+		}
+		else {
+			p = e; // not an exponent after all
+		}
+	}
+
+	// When the mantissa & the power of ten are both exact floats, one rounded multiplication or
+	// division gives the correctly rounded result (Clinger's fast path). Most .obj files have
+	// at most 7 digits, which fit. Going through a double instead would round twice, which is
+	// off by one ulp for some numbers (e.g. 4.963480710983276), so longer ones go to strtof.
+	static const float floatPowers[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+
+	if (mantissa <= (1u << 24) && exponent >= -10 && exponent <= 10) {
+		value = (float)mantissa;
+		value = exponent < 0 ? value / floatPowers[-exponent] : value * floatPowers[exponent];
+	}
+	else { // let the C library deal with it
+		char text[128];
+		size_t length = std::min((size_t)(p - start), sizeof(text) - 1);
+		memcpy(text, start, length);
+		text[length] = '\0';
+		value = strtof(text, nullptr);
+		return true;
+	}
+
+	if (negative) {
+		value = -value;
+	}
+	return true;
+}
+
+
+static bool parseInt(const char*& p, const char* end, int64_t& value) {
+	const char* start = p;
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) {
+		negative = *p == '-';
+		p++;
+	}
+	if (p >= end || !isDigit(*p)) {
+		p = start;
+		return false;
+	}
+	value = 0;
+	for (; p < end && isDigit(*p); p++) {
+		value = std::min(value * 10 + (*p - '0'), (int64_t)1 << 40);
+	}
+	if (negative) {
+		value = -value;
+	}
+	return true;
+}
+
+
+struct ObjChunk {
+	std::vector<glm::vec3> vertices;
+	std::vector<int64_t> indices;	// 0 based, 3 per triangle
+	std::vector<size_t> relative;	// which [indices] count from the first vertex of the chunk
+	const char* error = nullptr;	// the line that failed
+};
+
+
+// Parses the lines of [begin, end), which starts at a line & ends after one
+static void parseChunk(const char* begin, const char* end, ObjChunk& chunk) {
+	std::vector<int64_t> face;
+
+	const char* p = begin;
+	while (p < end) {
+		const char* line = p;
+		skipBlanks(p, end);
+
+		if (p + 1 < end && p[0] == 'v' && isBlank(p[1])) {
+			p++;
+			glm::vec3 vertex;
+			for (int axis = 0; axis < 3; axis++) {
+				skipBlanks(p, end);
+				if (!parseFloat(p, end, vertex[axis])) {
+					chunk.error = line;
+					return;
+				}
+			}
+			chunk.vertices.push_back(vertex); // a 4th (w) coordinate is ignored
+		}
+		else if (p + 1 < end && p[0] == 'f' && isBlank(p[1])) {
+			p++;
+			face.clear();
+			while (true) {
+				skipBlanks(p, end);
+				int64_t index;
+				if (!parseInt(p, end, index)) {
+					break;
+				}
+				// v/vt/vn or v//vn: only the position is kept
+				while (p < end && !isBlank(*p) && *p != '\n') {
+					p++;
+				}
+				face.push_back(index);
+			}
+			if (face.size() < 3) {
+				chunk.error = line;
+				return;
+			}
+
+			for (size_t k = 1; k + 1 < face.size(); k++) {
+				int64_t fan[3] = { face[0], face[k], face[k + 1] };
+				for (int64_t index : fan) {
+					if (index > 0) {
+						chunk.indices.push_back(index - 1);
+					}
+					else if (index < 0) { // -1 is the last vertex read so far
+						chunk.relative.push_back(chunk.indices.size());
+						chunk.indices.push_back((int64_t)chunk.vertices.size() + index);
+					}
+					else {
+						chunk.error = line;
+						return;
+					}
+				}
+			}
+		}
+
+		// Anything else (comments, vt, vn, groups, materials ...) is skipped
+		while (p < end && *p != '\n') {
+			p++;
+		}
+		p++;
+	}
+}
+
+
+static int lineOf(const char* data, const char* position) {
+	return 1 + (int)std::count(data, position, '\n');
+}
+
+
+// The face line of [begin, end) that made its [triangle]-th triangle, only looked for when
+// an index turns out to be wrong: faces made [parseChunk] fail otherwise, so they parse here.
+static const char* lineOfTriangle(const char* begin, const char* end, size_t triangle) {
+	const char* p = begin;
+	while (p < end) {
+		const char* line = p;
+		skipBlanks(p, end);
+		if (p + 1 < end && p[0] == 'f' && isBlank(p[1])) {
+			p++;
+			size_t corners = 0;
+			int64_t index;
+			while (skipBlanks(p, end), parseInt(p, end, index)) {
+				while (p < end && !isBlank(*p) && *p != '\n') {
+					p++;
+				}
+				corners++;
+			}
+			if (triangle < corners - 2) {
+				return line;
+			}
+			triangle -= corners - 2;
+		}
+		while (p < end && *p != '\n') {
+			p++;
+		}
+		p++;
+	}
+	return begin;
+}
+
+
+bool loadObj(const std::string& path, std::vector<glm::vec3>& vertices, std::vector<uint32_t>& indices,
+	std::string& error, int threads) {
+
+	MappedFile file;
+	if (!file.open(path)) {
+		error = "can't open " + path;
+		return false;
+	}
+	const char* data = file.data();
+	const char* end = data + file.size();
+
+	if (threads <= 0) {
+		threads = (int)std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), 1 + file.size() / OBJ_CHUNK_SIZE);
+	}
+
+	// One chunk per thread, each cut right after a line break
+	std::vector<const char*> cuts;
+	cuts.push_back(data);
+	for (int i = 1; i < threads; i++) {
+		const char* cut = std::max(cuts.back(), data + file.size() * i / threads);
+		while (cut < end && cut[-1] != '\n') {
+			cut++;
+		}
+		cuts.push_back(cut);
+	}
+	cuts.push_back(end);
+
+	std::vector<ObjChunk> chunks(threads);
+	std::vector<std::thread> workers;
+	for (int i = 1; i < threads; i++) {
+		workers.emplace_back(parseChunk, cuts[i], cuts[i + 1], std::ref(chunks[i]));
+	}
+	parseChunk(cuts[0], cuts[1], chunks[0]);
+	for (std::thread& worker : workers) {
+		worker.join();
+	}
+
+	// Concatenate, the chunks only knew their own vertices
+	size_t vertexCount = 0;
+	size_t indexCount = 0;
+	for (const ObjChunk& chunk : chunks) {
+		if (chunk.error) {
+			error = path + ": can't read line " + std::to_string(lineOf(data, chunk.error));
+			return false;
+		}
+		vertexCount += chunk.vertices.size();
+		indexCount += chunk.indices.size();
+	}
+
+	vertices.clear();
+	indices.clear();
+	vertices.reserve(vertexCount);
+	indices.reserve(indexCount);
+
+	for (size_t c = 0; c < chunks.size(); c++) {
+		ObjChunk& chunk = chunks[c];
+		int64_t first = (int64_t)vertices.size();
+		for (size_t r : chunk.relative) {
+			chunk.indices[r] += first;
+		}
+		vertices.insert(vertices.end(), chunk.vertices.begin(), chunk.vertices.end());
+
+		for (size_t i = 0; i < chunk.indices.size(); i++) {
+			int64_t index = chunk.indices[i];
+			if (index < 0 || index >= (int64_t)vertexCount) {
+				int line = lineOf(data, lineOfTriangle(cuts[c], cuts[c + 1], i / 3));
+				error = path + ": line " + std::to_string(line) + " refers to vertex " + std::to_string(index + 1)
+					+ " of " + std::to_string(vertexCount);
+				return false;
+			}
+			indices.push_back((uint32_t)index);
+		}
+	}
+
+	if (indices.empty()) {
+		error = path + " has no faces";
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,24 @@
+#ifndef obj_loader_h // include guard
+#define obj_loader_h
+
+#include <glm/glm.hpp>  // glm
+#include <stdint.h>		// uint32_t
+#include <string>		// std::string
+#include <vector>		// std::vector
+
+
+/// Reads the vertices & faces of a Wavefront .obj file, keeping its indexing: every "v" line
+/// becomes a vertex and every face refers to them, polygons being split into triangle fans.
+/// Texture coordinates, normals, groups & materials are skipped.
+///
+/// The file is mapped rather than read, and numbers are parsed in place without going through
+/// streams or the C locale. Big files are cut into chunks at line breaks and parsed by
+/// [threads] threads at once (0 picks a count from the file size).
+///
+/// Returns false with a message in [error] if the file can't be read, a line doesn't parse,
+/// a face refers to a vertex that doesn't exist, or there are no faces at all.
+bool loadObj(const std::string& path, std::vector<glm::vec3>& vertices, std::vector<uint32_t>& indices,
+	std::string& error, int threads = 0);
+
+
+#endif obj_loader_h
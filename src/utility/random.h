@@ -0,0 +1,51 @@
+#ifndef random_h // include guard
+#define random_h
+
+#include <stdint.h>  // uint32_t, uint64_t
+
+
+class Random {
+	/// Small & fast PCG32 generator (http://www.pcg-random.org), replaces rand().
+	///
+	/// rand() shares one global state between all threads, so it either serializes the
+	/// render or races, and the result depends on the order the pixels are traced in.
+	/// Instead, every pixel gets its own generator: the [seed] comes from the scene and the
+	/// [stream] is the pixel index, so a frame is reproducible regardless of the thread count.
+public:
+	Random(uint64_t seed = 0, uint64_t stream = 0) {
+		state = 0;
+		increment = (stream << 1u) | 1u;
+		next();
+		state += seed;
+		next();
+	}
+
+	uint32_t next() {
+		uint64_t old = state;
+		state = old * 6364136223846793005ULL + increment;
+		uint32_t xorshifted = (uint32_t)(((old >> 18u) ^ old) >> 27u);
+		uint32_t rot = (uint32_t)(old >> 59u);
+		return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+	}
+
+	// A new generator seeded from this one, e.g. for a secondary ray.
+	// What it draws doesn't depend on what this one draws afterwards.
+	Random split() {
+		uint64_t seed = next();
+		seed = (seed << 32) | next();
+		uint64_t stream = next();
+		return Random(seed, stream);
+	}
+
+	// Uniform float in [0, 1)
+	float uniform() {
+		return (next() >> 8) * (1.0f / 16777216.0f);
+	}
+
+private:
+	uint64_t state;
+	uint64_t increment;
+};
+
+
+#endif random_h
@@ -2,9 +2,182 @@
 
 #include "scene_adapter.h"
 #include "texture.h"
+#include "obj_loader.h"
+#include "mesh_file.h"
+#include "mapped_file.h"
+#include "scene_cache.h"
+
+#include <atomic>	// std::atomic
+#include <chrono>	// std::chrono::high_resolution_clock
+#include <deque>	// std::deque
+#include <memory>	// std::unique_ptr
 
 const char* PATH = "scenes/";
 
+bool SceneAdapter::useCache = false;
+bool SceneAdapter::compareTrees = false;
+
+
+class SceneReader : public nlohmann::json_sax<json> {
+	/// Handler for json::sax_parse, building the DOM of a scene as nlohmann's parser does,
+	/// except for the "triangles" of meshes. Their numbers go straight into [meshes] as they
+	/// are read, and the DOM only gets the index of the mesh there. A big inline mesh then
+	/// costs 12 bytes per corner instead of a json value per number plus one array per corner.
+public:
+	std::string error;
+
+	SceneReader(json& scene, std::vector<std::vector<glm::vec3>>& meshes) : scene(scene), meshes(meshes) {}
+
+	bool null() override {
+		return value() ? fail() : add(nullptr);
+	}
+	bool boolean(bool val) override {
+		return value() ? fail() : add(val);
+	}
+	bool number_integer(number_integer_t val) override {
+		return value() ? number((float)val) : add(val);
+	}
+	bool number_unsigned(number_unsigned_t val) override {
+		return value() ? number((float)val) : add(val);
+	}
+	bool number_float(number_float_t val, const string_t&) override {
+		return value() ? number((float)val) : add(val);
+	}
+	bool string(string_t& val) override {
+		return value() ? fail() : add(val);
+	}
+	bool start_object(std::size_t) override {
+		if (value()) {
+			return fail();
+		}
+		open.push_back(place(json::object()));
+		return true;
+	}
+	bool key(string_t& val) override {
+		isTriangles = val == "triangles";
+		member = &(*open.back())[val];
+		return true;
+	}
+	bool end_object() override {
+		open.pop_back();
+		return true;
+	}
+
+	bool start_array(std::size_t) override {
+		if (depth > 0) {
+			if (++depth > 3) {
+				return fail();
+			}
+			if (depth == 2) {
+				corners = 0;
+			}
+			count = 0;
+			return true;
+		}
+		if (isTriangles) {
+			isTriangles = false;
+			depth = 1;
+			meshes.emplace_back();
+			return true;
+		}
+		open.push_back(place(json::array()));
+		return true;
+	}
+
+	bool end_array() override {
+		if (depth == 0) {
+			open.pop_back();
+			return true;
+		}
+		if (depth == 3) {
+			if (count != 3) {
+				return fail();
+			}
+			meshes.back().push_back(corner);
+			corners++;
+		}
+		else if (depth == 2 && corners != 3) {
+			return fail();
+		}
+		if (--depth == 0) {
+			if (meshes.back().empty()) {
+				error = "a mesh has no triangles";
+				return false;
+			}
+			return add(meshes.size() - 1);
+		}
+		return true;
+	}
+
+	bool parse_error(std::size_t, const std::string&, const json::exception& exception) override {
+		error = exception.what();
+		return false;
+	}
+
+private:
+	json& scene;
+	std::vector<json*> open;	// the objects & arrays being read, innermost last
+	json* member = nullptr;		// where the value of the last key goes
+	std::vector<std::vector<glm::vec3>>& meshes;
+	bool isTriangles = false;	// the value being read is the one of a "triangles" key
+	int depth = 0;				// 1 in the triangles array, 2 in a triangle, 3 in a corner
+	int corners = 0;			// corners of the triangle read so far
+	int count = 0;				// coordinates of [corner] read so far
+	glm::vec3 corner;
+
+	// Puts a value where the DOM expects the next one: the whole scene, the next element of
+	// an array or the member of the last key
+	json* place(json&& val) {
+		if (open.empty()) {
+			scene = std::move(val);
+			return &scene;
+		}
+		if (open.back()->is_array()) {
+			open.back()->push_back(std::move(val));
+			return &open.back()->back();
+		}
+		*member = std::move(val);
+		return member;
+	}
+
+	template <typename T>
+	bool add(T val) {
+		place(json(val));
+		return true;
+	}
+
+	// True for the value of a "triangles" key or anything inside it but the arrays (a scalar
+	// or object there is an error)
+	bool value() {
+		bool triangles = isTriangles;
+		isTriangles = false;
+		return triangles || depth > 0;
+	}
+
+	bool number(float val) {
+		if (depth != 3 || count == 3) {
+			return fail();
+		}
+		corner[count++] = val;
+		return true;
+	}
+
+	bool fail() {
+		error = "the triangles of a mesh should be lists of 3 [x, y, z] corners";
+		return false;
+	}
+};
+
+
+
+HierarchyType toHierarchyType(const std::string& name) {
+	HierarchyType type;
+	if (!parseHierarchyType(name, type)) {
+		std::cout << "Unknown bvh type " << name << ", expected \"octree\", \"sah\" or \"lbvh\"" << std::endl;
+		exit(EXIT_FAILURE);
+	}
+	return type;
+}
 
 
 json find(json& j, const std::string key, const std::string value) {
@@ -34,13 +207,34 @@ void SceneAdapter::chooseScene(char const* fn) {
 	std::cout << "Loading scene " << fn << std::endl;
 
 	std::string fname = PATH + std::string(fn) + ".json";
-	std::fstream in(fname);
-	if (!in.is_open()) {
-		std::cout << "Unable to open scene file " << fname << std::endl;
-		exit(EXIT_FAILURE);
+	sceneFile = fname;
+	cacheFile = PATH + std::string(fn) + ".scene";
+
+	auto start = std::chrono::high_resolution_clock::now();
+	if (useCache && cache.open(cacheFile, fname, scene)) {
+		std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+		printf("Using the compiled scene %s, checked in %.3f s\n", cacheFile.c_str(), elapsed.count());
 	}
+	else {
+		MappedFile file;
+		if (!file.open(fname)) {
+			std::cout << "Unable to open scene file " << fname << std::endl;
+			exit(EXIT_FAILURE);
+		}
 
-	in >> scene;
+		SceneReader reader(scene, inlineTriangles);
+		if (!json::sax_parse(file.data(), file.data() + file.size(), &reader)) {
+			std::cout << "Unable to read scene file " << fname << ": " << reader.error << std::endl;
+			exit(EXIT_FAILURE);
+		}
+		std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+		size_t corners = 0;
+		for (const std::vector<glm::vec3>& mesh : inlineTriangles) {
+			corners += mesh.size();
+		}
+		printf("Parsed %s in %.3f s (%.1f KB, %u inline triangles)\n",
+			fname.c_str(), elapsed.count(), file.size() / 1024.0, (unsigned)(corners / 3));
+	}
 
 	json camera = scene["camera"];
 	// these are optional parameters (otherwise they default to the values initialized earlier)
@@ -57,12 +251,194 @@ void SceneAdapter::chooseScene(char const* fn) {
 		antialiasing = camera["antialiasing"];
 		std::cout << "Antialiasing is " << (antialiasing ? "ON" : "OFF") << std::endl;
 	}
+
+	if (camera.find("bvh") != camera.end()) {
+		hierarchy = toHierarchyType(camera["bvh"]);
+		std::cout << "Using " << hierarchyTypeName(hierarchy) << " hierarchies for meshes" << std::endl;
+	}
+
+	if (camera.find("bounces") != camera.end()) {
+		bounces = camera["bounces"];
+		std::cout << "Setting max bounces to " << bounces << std::endl;
+	}
+
+	if (camera.find("cutoff") != camera.end()) {
+		cutoff = camera["cutoff"];
+		std::cout << "Setting throughput cutoff to " << cutoff << std::endl;
+	}
+
+	if (camera.find("roulette") != camera.end()) {
+		roulette = camera["roulette"];
+		std::cout << "Russian roulette is " << (roulette ? "ON" : "OFF") << std::endl;
+	}
+
+	if (camera.find("seed") != camera.end()) {
+		seed = camera["seed"];
+		std::cout << "Setting random seed to " << seed << std::endl;
+	}
 }
 
 
 /****************************************************************************/
 
-void SceneAdapter::loadThings() {
+// Stages of loading a mesh, timed by [buildMesh]
+enum { LOAD_READ, LOAD_PACK, LOAD_BUILD, LOAD_FLATTEN, LOAD_STAGES };
+static const char* LOAD_STAGE_NAMES[LOAD_STAGES] = { "read", "transform & pack", "build", "flatten" };
+
+
+// One mesh of the scene, loaded by a task of its own. What the task needs is copied out of
+// the json first, as the main thread keeps walking it meanwhile.
+struct MeshLoad {
+	Mesh* mesh = nullptr;
+	FlatHierarchy* tree = nullptr;		// filled in by the task
+	std::string fname;					// an .obj or a .mesh, empty otherwise
+	MappedFile* file = nullptr;			// for a .mesh
+	std::vector<glm::vec3>* corners = nullptr;	// inline triangles
+	long long compiled = -1;			// index in the scene cache
+	json transform;						// null if none
+	HierarchyType type = HierarchyType::octree;
+
+	// Results, reported once every task is done
+	std::string error;
+	bool mapped = false;				// traced straight from a file, nothing was built
+	HierarchyStats stats;
+	HierarchyStats octreeStats;			// with [SceneAdapter::compareTrees], when [type] isn't the octree
+	double seconds[LOAD_STAGES] = {};
+};
+
+
+static bool isMeshFile(const std::string& fname) {
+	return fname.size() > 5 && fname.compare(fname.size() - 5, 5, ".mesh") == 0;
+}
+
+
+static void applyTransform(Mesh& mesh, const json& transform) {
+	if (transform.find("scale") != transform.end()) {
+		mesh.scale(transform["scale"]);
+	}
+	if (transform.find("translate") != transform.end()) {
+		mesh.translate(vector_to_vec3(transform["translate"]));
+	}
+
+	if (transform.find("new_origin") != transform.end()) {
+		if (transform["new_origin"] == true) {
+			mesh.resetOrigin();
+		}
+	}
+	if (transform.find("scale") != transform.end()) {
+		mesh.scale(transform["scale"]);
+	}
+	if (transform.find("rotation") != transform.end()) {
+		const json& rotation = transform["rotation"];
+		glm::vec3 axis = vector_to_vec3(rotation["axis"]);
+		float angle = rotation["angle"];
+		mesh.addQuaternion(axis, angle);
+		mesh.rotate();
+	}
+}
+
+
+// Reads, transforms & packs a mesh, then builds its tree: everything that only touches [load]
+static void buildMesh(MeshLoad& load, const SceneCache& cache, Scheduler* scheduler) {
+	Mesh* mesh = load.mesh;
+	FlatHierarchy* tree = load.tree;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	auto lap = [&](int stage) {
+		auto now = std::chrono::high_resolution_clock::now();
+		load.seconds[stage] += std::chrono::duration<double>(now - start).count();
+		start = now;
+	};
+
+	if (load.compiled >= 0) {
+		// Transformed, packed & with its tree already, see [SceneCache]
+		if (!cache.loadMesh((size_t)load.compiled, *mesh, tree->nodes, load.error)) {
+			return;
+		}
+		load.mapped = true;
+	}
+	else if (load.file) {
+		// Converted by meshconv, mapped and used in place, tree included
+		if (!load.file->open(load.fname, false)) {
+			load.error = "can't open " + load.fname;
+			return;
+		}
+		if (!loadMesh(*load.file, *mesh, tree->nodes, load.error)) {
+			load.error = load.fname + ": " + load.error;
+			return;
+		}
+		load.mapped = true;
+	}
+	else if (!load.fname.empty()) {
+		// Read straight into the indexed arrays of the mesh
+		if (!loadObj(load.fname, mesh->vertices, mesh->indices, load.error)) {
+			return;
+		}
+	}
+	else {
+		// Read by [chooseScene], and not needed once indexed
+		mesh->setTriangles(*load.corners);
+		std::vector<glm::vec3>().swap(*load.corners);
+	}
+
+	if (load.mapped && (tree->nodes.empty() || !load.transform.is_null())) {
+		// Copied out of the file to be transformed or get a tree, as any other mesh
+		mesh->vertices.assign(mesh->vertexView.begin(), mesh->vertexView.end());
+		mesh->indices.assign(mesh->indexView.begin(), mesh->indexView.end());
+		load.mapped = false;
+	}
+	lap(LOAD_READ);
+
+	if (load.mapped) {
+		mesh->setTextureAxes();
+		tree->mesh = mesh;
+		tree->center = mesh->center;
+		lap(LOAD_PACK);
+		return;
+	}
+
+	if (!load.transform.is_null()) {
+		applyTransform(*mesh, load.transform);
+	}
+	mesh->resetOrigin();
+	mesh->pack();
+	lap(LOAD_PACK);
+
+	// The pointer tree is only needed until it is flattened, so it gets an arena of its own
+	Arena buildArena;
+	MeshHierarchy* mh = buildArena.make<MeshHierarchy>();
+	mh->arena = &buildArena;
+	mh->build(mesh, load.type, scheduler);
+	load.stats = mh->getStats();
+
+	if (SceneAdapter::compareTrees && load.type != HierarchyType::octree) {
+		MeshHierarchy octree = MeshHierarchy();
+		octree.arena = &buildArena;
+		octree.build(mesh, HierarchyType::octree, scheduler);
+		load.octreeStats = octree.getStats();
+	}
+	lap(LOAD_BUILD);
+
+	// Tracing uses a flat copy of the tree
+	tree->type = load.type;
+	tree->flatten(mh);
+	lap(LOAD_FLATTEN);
+}
+
+
+void SceneAdapter::loadThings(Scheduler* scheduler) {
+	auto start = std::chrono::high_resolution_clock::now();
+
+	// Meshes & texture images are loaded by tasks, while the json is walked on this thread
+	std::unique_ptr<Scheduler> ownScheduler;
+	if (scheduler == nullptr) {
+		ownScheduler.reset(new Scheduler());
+		scheduler = ownScheduler.get();
+	}
+	TaskGroup loading;
+	std::deque<MeshLoad> meshLoads; // not moved while the tasks run
+	std::atomic<long long> textureNanoseconds{ 0 };
+	int textures = 0;
 
 	json& jsonObjects = scene["objects"];
 
@@ -79,7 +455,7 @@ void SceneAdapter::loadThings() {
 
 		// Textures	
 
-		Texture* texture = new Texture();
+		Texture* texture = arena.make<Texture>();
 
 		if (object.find("texture") != object.end()) {
 			json& jsonTexture = object["texture"];
@@ -97,20 +473,30 @@ void SceneAdapter::loadThings() {
 			if (jsonTexture.find("custom") != jsonTexture.end()) {
 				texture->mode = TextureMode::custom;
 				json& custom = jsonTexture["custom"];
+				const char* location = nullptr;
 				if (custom == "lava") {
-					texture->loadBMP("textures/lava24.bmp");
+					location = "textures/lava24.bmp";
 				}
 				else if (custom == "stone") {
-					texture->loadBMP("textures/stone24.bmp");
+					location = "textures/stone24.bmp";
 				}
 				else if (custom == "paper") {
-					texture->loadBMP("textures/paper24.bmp");
+					location = "textures/paper24.bmp";
 				}
 				else if (custom == "metal") {
-					texture->loadBMP("textures/metal24.bmp");
+					location = "textures/metal24.bmp";
 				}
 				else if (custom == "obsidian") {
-					texture->loadBMP("textures/obsidian24.bmp");
+					location = "textures/obsidian24.bmp";
+				}
+				if (location) {
+					textures++;
+					scheduler->spawn(loading, [texture, location, &textureNanoseconds]() {
+						auto start = std::chrono::high_resolution_clock::now();
+						texture->loadBMP(location);
+						textureNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(
+							std::chrono::high_resolution_clock::now() - start).count();
+					});
 				}
 			}			
 		}
@@ -121,7 +507,7 @@ void SceneAdapter::loadThings() {
 	
 		// Materials	
 
-		Material* material = new Material();
+		Material* material = arena.make<Material>();
 		json& jsonMaterial = object["material"];
 
 		if (jsonMaterial.find("ambient") != jsonMaterial.end()) {
@@ -156,7 +542,7 @@ void SceneAdapter::loadThings() {
 		// Objects
 
 		if (object["type"] == "sphere") {
-			Sphere* sphere = new Sphere();
+			Sphere* sphere = arena.make<Sphere>();
 			sphere->radius = float(object["radius"]);
 			sphere->center = vector_to_vec3(object["position"]);
 			sphere->material = material;	
@@ -169,7 +555,7 @@ void SceneAdapter::loadThings() {
 		}
 
 		else if (object["type"] == "plane") {
-			Plane* plane = new Plane();
+			Plane* plane = arena.make<Plane>();
 			plane->center = vector_to_vec3(object["position"]);
 			plane->normal = normalize(vector_to_vec3(object["normal"]));
 			plane->material = material;		
@@ -180,59 +566,46 @@ void SceneAdapter::loadThings() {
 		}
 
 		else if (object["type"] == "mesh") {
+			meshLoads.emplace_back();
+			MeshLoad& load = meshLoads.back();
+			load.mesh = arena.make<Mesh>();
+			load.tree = arena.make<FlatHierarchy>();
 
-			std::vector<Triangle*> triangles;
-						
-			for (std::vector<std::vector<float>> triangleJson : object["triangles"]) {
-				Triangle* triangle = new Triangle();
-				triangle->points.push_back(vector_to_vec3(triangleJson[0]));
-				triangle->points.push_back(vector_to_vec3(triangleJson[1]));
-				triangle->points.push_back(vector_to_vec3(triangleJson[2]));	
-				triangle->material = material;				
-				triangle->texture = texture;		
-				triangle->isNegative = isNegative;
-				triangles.push_back(triangle);
-			}
-						
-			Mesh* mesh = new Mesh();
-			mesh->triangles = triangles;
-
-			printf("Added a mesh, Triangles count = %d\n", triangles.size());
+			load.mesh->material = material;
+			load.mesh->texture = texture;
+			load.mesh->isNegative = isNegative;
 
-			if (object.find("transform") != object.end()) {
-				json& jsonTransform = object["transform"];
-				if (jsonTransform.find("scale") != jsonTransform.end()) {
-					mesh->scale(jsonTransform["scale"]);
-				}
-				if (jsonTransform.find("translate") != jsonTransform.end()) {
-					mesh->translate(vector_to_vec3(jsonTransform["translate"]));
-				}			
-				
-				if (jsonTransform.find("new_origin") != jsonTransform.end()) {
-					if ((jsonTransform["new_origin"]) == true) {
-						mesh->resetOrigin();
-					}
+			if (object.find("compiled") != object.end()) {
+				load.compiled = object["compiled"];
+			}
+			else if (object.find("file") != object.end()) {
+				load.fname = PATH + object["file"].get<std::string>();
+				if (isMeshFile(load.fname)) {
+					load.file = arena.make<MappedFile>(); // lives as long as the mesh
 				}
-				if (jsonTransform.find("scale") != jsonTransform.end()) {
-					mesh->scale(jsonTransform["scale"]);					
+				assets.push_back(load.fname);
+			}
+			else {
+				// The index the reader put in place of the triangles, unless they are missing
+				json& triangles = object["triangles"];
+				if (!triangles.is_number_unsigned() || triangles.get<size_t>() >= inlineTriangles.size()) {
+					std::cout << "A mesh needs \"triangles\" or a \"file\"" << std::endl;
+					exit(EXIT_FAILURE);
 				}
-				if (jsonTransform.find("rotation") != jsonTransform.end()) {
-					json& jsonRot = jsonTransform["rotation"];
-					glm::vec3 axis = vector_to_vec3(jsonRot["axis"]);
-					float angle = jsonRot["angle"];
-					mesh->addQuaternion(axis, angle);
-					mesh->rotate();
-				}					
+				load.corners = &inlineTriangles[triangles.get<size_t>()];
 			}
-						
-			mesh->resetOrigin();
-			mesh->resetBarycenters();
-			mesh->resetNormals();
 
-			MeshHierarchy* mh = new MeshHierarchy();	
-			mh->build(mesh);			
+			if (object.find("transform") != object.end()) {
+				load.transform = object["transform"];
+			}
+			load.type = hierarchy;
+			if (object.find("bvh") != object.end()) {
+				load.type = toHierarchyType(object["bvh"]);
+			}
 
-			objects.push_back(mh);
+			compile(object, load.tree);
+			objects.push_back(load.tree); // filled by the task
+			scheduler->spawn(loading, [&load, scheduler, this]() { buildMesh(load, cache, scheduler); });
 		}
 	}	
 
@@ -243,24 +616,24 @@ void SceneAdapter::loadThings() {
 		json& light = *it;
 
 		if (light["type"] == "ambient") {
-			Ambient* ambient = new Ambient();
+			Ambient* ambient = arena.make<Ambient>();
 			ambient->colour = vector_to_vec3(light["color"]);
 			lights.push_back(ambient);
 		}
 		else if (light["type"] == "point") {
-			Point* point = new Point();
+			Point* point = arena.make<Point>();
 			point->colour = vector_to_vec3(light["color"]);
 			point->position = vector_to_vec3(light["position"]);
 			lights.push_back(point);
 		}
 		else if (light["type"] == "directional") {
-			Directional* directional = new Directional();
+			Directional* directional = arena.make<Directional>();
 			directional->colour = vector_to_vec3(light["color"]);
 			directional->direction = normalize(vector_to_vec3(light["direction"]));
 			lights.push_back(directional);
 		}
 		else if (light["type"] == "spot") {
-			Spot* spot = new Spot();
+			Spot* spot = arena.make<Spot>();
 			spot->colour = vector_to_vec3(light["color"]);
 			spot->direction = normalize(vector_to_vec3(light["direction"])); // oh well..
 			spot->position = vector_to_vec3(light["position"]);
@@ -268,7 +641,7 @@ void SceneAdapter::loadThings() {
 			lights.push_back(spot);
 		}
 		else if (light["type"] == "area") {
-			Area* area = new Area();
+			Area* area = arena.make<Area>();
 			area->colour = vector_to_vec3(light["color"]);			
 			area->position = vector_to_vec3(light["position"]);
 			area->dirU = vector_to_vec3(light["dirU"]);
@@ -277,7 +650,133 @@ void SceneAdapter::loadThings() {
 			area->distV = float(light["distV"]);
 			area->normal = normalize(cross(area->dirU, area->dirV));
 			lights.push_back(area);					
-			objects.push_back(area->makeLamp());
+			objects.push_back(area->makeLamp(arena));
 		}
 	}
+
+	scheduler->wait(loading);
+
+	double stages[LOAD_STAGES] = {};
+	for (MeshLoad& load : meshLoads) {
+		if (!load.error.empty()) {
+			std::cout << "Unable to load mesh: " << load.error << std::endl;
+			exit(EXIT_FAILURE);
+		}
+		for (int i = 0; i < LOAD_STAGES; i++) {
+			stages[i] += load.seconds[i];
+		}
+
+		Mesh* mesh = load.mesh;
+		if (!load.fname.empty()) {
+			printf("Read %s in %.3f s\n", load.fname.c_str(), load.seconds[LOAD_READ]);
+		}
+		if (load.mapped) {
+			printf("Mapped a mesh, Triangles count = %u, %u vertices, %u nodes\n",
+				mesh->triangleCount(), (unsigned)mesh->vertexView.size, (unsigned)load.tree->nodes.size);
+			continue;
+		}
+		printf("Added a mesh, Triangles count = %u, %u vertices, %.1f bytes per triangle\n",
+			mesh->triangleCount(), (unsigned)mesh->vertexView.size, mesh->memorySize() / (float)mesh->triangleCount());
+		load.stats.print(hierarchyTypeName(load.type));
+		if (compareTrees && load.type != HierarchyType::octree) { // to compare against the default
+			load.octreeStats.print("octree");
+		}
+	}
+
+	auto topStart = std::chrono::high_resolution_clock::now();
+	topLevel.build(objects);
+	auto finish = std::chrono::high_resolution_clock::now();
+	topLevel.printStats();
+
+	std::chrono::duration<double> topElapsed = finish - topStart;
+	std::chrono::duration<double> elapsed = finish - start;
+	printf("Loading stages, summed over %u meshes: ", (unsigned)meshLoads.size());
+	for (int i = 0; i < LOAD_STAGES; i++) {
+		printf("%s %.3f s, ", LOAD_STAGE_NAMES[i], stages[i]);
+	}
+	printf("%d textures %.3f s, top level %.3f s\n", textures, textureNanoseconds / 1e9, topElapsed.count());
+	printf("Loaded the objects in %.3f s on %d threads\n", elapsed.count(), scheduler->size());
+
+	printf("Scene arena: %.1f KB used in %d blocks of %.1f KB\n",
+		arena.bytesUsed() / 1024.0, arena.blockCount(), arena.bytesReserved() / 1024.0);
+
+	if (useCache && !cache.isOpen()) {
+		std::string error;
+		if (SceneCache::save(cacheFile, sceneFile, assets, scene, compiled, error)) {
+			printf("Saved the compiled scene to %s\n", cacheFile.c_str());
+		}
+		else {
+			std::cout << "Unable to save the compiled scene: " << error << std::endl;
+		}
+	}
+
+	// Everything has been read out of the json
+	scene = json();
+	inlineTriangles.clear();
+}
+
+
+void SceneAdapter::updateMeshes(Scheduler* scheduler) {
+	auto start = std::chrono::high_resolution_clock::now();
+
+	// Each tree is refitted (or rebuilt) by a task of its own, like it was loaded
+	TaskGroup updating;
+	std::atomic<int> rebuilt{ 0 };
+	int trees = 0;
+	for (Object* object : objects) {
+		FlatHierarchy* tree = dynamic_cast<FlatHierarchy*>(object);
+		if (tree == NULL) {
+			continue;
+		}
+		trees++;
+		if (scheduler) {
+			scheduler->spawn(updating, [tree, scheduler, &rebuilt]() { rebuilt += tree->update(scheduler) ? 1 : 0; });
+		}
+		else {
+			rebuilt += tree->update() ? 1 : 0;
+		}
+	}
+	if (scheduler) {
+		scheduler->wait(updating);
+	}
+
+	// The boxes of the meshes moved too
+	topLevel.build(objects);
+
+	std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+	printf("Updated %d mesh trees in %.3f s, %d rebuilt\n", trees, elapsed.count(), rebuilt.load());
+
+	if (!compareTrees) {
+		return;
+	}
+	// How much the refitted trees lost against new ones over the same triangles (built on a
+	// copy, a build reorders them)
+	for (Object* object : objects) {
+		FlatHierarchy* tree = dynamic_cast<FlatHierarchy*>(object);
+		if (tree == NULL || tree->nodeStorage.empty()) {
+			continue;
+		}
+		Mesh copy = *tree->mesh;
+		copy.pack();
+		FlatHierarchy fresh;
+		fresh.mesh = &copy;
+		fresh.type = tree->type;
+		fresh.rebuild(scheduler);
+		printf("  %u triangles (%s): SAH cost %.2f refitted, %.2f for a new tree, %.2f when built\n",
+			tree->mesh->triangleCount(), hierarchyTypeName(tree->type), tree->cost(), fresh.cost(), tree->builtCost);
+	}
+}
+
+
+void SceneAdapter::compile(json& object, FlatHierarchy* tree) {
+	if (!useCache || cache.isOpen()) {
+		return;
+	}
+	// The cache gets the mesh as it is now, so what built it goes
+	object["compiled"] = compiled.size();
+	object.erase("triangles");
+	object.erase("file");
+	object.erase("transform");
+	object.erase("bvh");
+	compiled.push_back(tree);
 }
@@ -6,6 +6,9 @@
 #include <glm/gtx/string_cast.hpp>	// to_string
 
 #include "json.hpp"
+#include "arena.h"
+#include "scene_cache.h"
+#include "scheduler.h"
 
 #include "../models/model.h"
 #include "../acceleration/acceleration.h"
@@ -15,16 +18,54 @@
 using json = nlohmann::json;
 
 class SceneAdapter {
+	/// Loads a scene from json. Every object, material, texture & light of the scene is allocated
+	/// in [arena], so they are all freed at once with the adapter.
+	///
+	/// The file is parsed as a stream ([chooseScene]): the inline triangles of meshes are read
+	/// straight into [inlineTriangles] instead of the json, which is released by [loadThings].
+	/// There, every mesh (read, transform, pack, tree) and texture image is loaded by a task of
+	/// its own, and the scene is ready once they are all done.
 public:	
+	Arena arena; // first, so it outlives the members pointing into it
 	json scene;
+	std::vector<std::vector<glm::vec3>> inlineTriangles; // 3 corners per triangle, indexed by "triangles"
 	double fov = 60;
 	bool antialiasing = false;
+	unsigned seed = 0;
+	int bounces = 5;
+	float cutoff = 0.0f;		// bounces with a lower throughput aren't traced, 0 traces them all
+	bool roulette = false;			// ... or only some of them are, scaled up so the image stays unbiased
+	HierarchyType hierarchy = HierarchyType::octree; // default for every mesh
 	glm::vec3 background_colour;
 	std::vector<Object*> objects;
 	std::vector<Light*> lights;
+	SceneHierarchy topLevel; // over [objects], built once everything is loaded
+
+	/// With [useCache], a scene is compiled into a .scene file next to its .json after it is
+	/// loaded, and later loads use that instead while it is up to date (see [SceneCache]).
+	static bool useCache;
+
+	/// With [compareTrees], meshes built with another tree also get an octree, only to print
+	/// its statistics next to theirs, and [updateMeshes] compares every refitted tree to a new one.
+	/// It doubles the build time & memory, so it is off by default.
+	static bool compareTrees;
+	SceneCache cache;
+	std::string sceneFile;
+	std::string cacheFile;
+	std::vector<std::string> assets;		// models loaded by the scene
+	std::vector<FlatHierarchy*> compiled;	// meshes going into the cache
 
 	void chooseScene(char const* fn);
-	void loadThings();
+	void loadThings(Scheduler* scheduler = nullptr); // on a pool of its own without one
+
+	/// After the vertices of meshes changed (e.g. between the frames of an animation): refits the
+	/// tree of every mesh, or rebuilds the ones that got too slow (see [FlatHierarchy::update]),
+	/// then the top level. Meshes mapped from a file can't change and are left as they are.
+	/// With [compareTrees], the cost of every tree is printed next to the one of a new tree.
+	void updateMeshes(Scheduler* scheduler = nullptr);
+
+private:
+	void compile(json& object, FlatHierarchy* tree); // records a finished mesh for the cache
 };
 
 #endif scene_adapter_h
\ No newline at end of file
@@ -0,0 +1,198 @@
+#include "scene_cache.h"
+#include "mesh_file.h"
+
+#include <algorithm>	// std::max
+#include <fstream>		// std::ofstream
+#include <functional>	// std::hash
+#include <stdio.h>		// rename, remove
+#include <string.h>		// memcpy, memcmp
+#include <thread>		// std::this_thread
+
+#ifdef _WIN32
+#include <process.h>	// _getpid
+#define getpid _getpid
+#else
+#include <unistd.h>		// getpid
+#endif
+
+
+static const char SCENE_CACHE_MAGIC[8] = { 'R', 'T', 'S', 'C', 'E', 'N', 'E', 0 };
+
+
+// FNV-1a over 8 bytes at a time, with the high bits folded back in so every byte reaches
+// the whole hash. Returns 0 for a file that can't be read.
+static uint64_t hashFile(const std::string& path) {
+	MappedFile file;
+	if (!file.open(path)) {
+		return 0;
+	}
+	const uint64_t prime = 1099511628211ull;
+	uint64_t hash = 14695981039346656037ull ^ file.size();
+	const char* data = file.data();
+	size_t i = 0;
+	for (; i + sizeof(uint64_t) <= file.size(); i += sizeof(uint64_t)) {
+		uint64_t word;
+		memcpy(&word, data + i, sizeof(word));
+		hash = (hash ^ word) * prime;
+		hash ^= hash >> 29;
+	}
+	for (; i < file.size(); i++) {
+		hash = (hash ^ (unsigned char)data[i]) * prime;
+	}
+	return hash;
+}
+
+
+// Same as [MeshHierarchy::build]
+static uint32_t leafSize() {
+	return (uint32_t)std::max(4, triangleLanes(triangleKernel()));
+}
+
+
+bool SceneCache::open(const std::string& path, const std::string& source, json& scene) {
+	if (!file.open(path, false)) {
+		return false;
+	}
+
+	SceneCacheHeader header;
+	bool valid = file.size() >= sizeof(header);
+	if (valid) {
+		memcpy(&header, file.data(), sizeof(header));
+		valid = memcmp(header.magic, SCENE_CACHE_MAGIC, sizeof(header.magic)) == 0
+			&& header.version == SCENE_CACHE_VERSION
+			&& header.meshVersion == MESH_FILE_VERSION
+			&& header.leafSize == leafSize()
+			&& header.fileSize == file.size()
+			&& header.jsonOffset <= file.size() && header.jsonSize <= file.size() - header.jsonOffset
+			&& header.meshTableOffset % sizeof(uint64_t) == 0 && header.meshTableOffset <= file.size()
+			&& 2 * (uint64_t)header.meshCount * sizeof(uint64_t) <= file.size() - header.meshTableOffset
+			&& header.sourceHash == hashFile(source);
+	}
+
+	json contents;
+	if (valid) {
+		const char* text = file.data() + header.jsonOffset;
+		contents = json::parse(text, text + header.jsonSize, nullptr, false);
+		valid = contents.is_object() && contents["assets"].is_array() && contents["scene"].is_object();
+	}
+	if (valid) {
+		try {
+			for (json& asset : contents["assets"]) {
+				if (hashFile(asset.at("file").get<std::string>()) != asset.at("hash").get<uint64_t>()) {
+					valid = false;
+					break;
+				}
+			}
+		}
+		catch (const json::exception&) { // a damaged json that still parses, e.g. a missing or mistyped field
+			valid = false;
+		}
+	}
+
+	if (!valid) {
+		file.close();
+		return false;
+	}
+
+	scene = std::move(contents["scene"]);
+	meshCount = header.meshCount;
+	meshTable = (const uint64_t*)(file.data() + header.meshTableOffset);
+	return true;
+}
+
+
+bool SceneCache::isOpen() const {
+	return meshTable != nullptr;
+}
+
+
+bool SceneCache::loadMesh(size_t index, Mesh& mesh, ArrayView<FlatNode>& nodes, std::string& error) const {
+	if (index >= meshCount) {
+		error = "the compiled scene has no mesh " + std::to_string(index);
+		return false;
+	}
+	uint64_t offset = meshTable[2 * index];
+	uint64_t size = meshTable[2 * index + 1];
+	if (offset > file.size() || size > file.size() - offset) {
+		error = "the compiled scene is damaged";
+		return false;
+	}
+	return ::loadMesh(file.data() + offset, size, mesh, nodes, error);
+}
+
+
+bool SceneCache::save(const std::string& path, const std::string& source, const std::vector<std::string>& assets,
+	const json& scene, const std::vector<FlatHierarchy*>& meshes, std::string& error) {
+
+	json contents;
+	contents["assets"] = json::array();
+	for (const std::string& asset : assets) {
+		contents["assets"].push_back({ { "file", asset }, { "hash", hashFile(asset) } });
+	}
+	contents["scene"] = scene;
+	std::string text = contents.dump();
+
+	SceneCacheHeader header = SceneCacheHeader();
+	memcpy(header.magic, SCENE_CACHE_MAGIC, sizeof(header.magic));
+	header.version = SCENE_CACHE_VERSION;
+	header.meshVersion = MESH_FILE_VERSION;
+	header.leafSize = leafSize();
+	header.meshCount = (uint32_t)meshes.size();
+	header.sourceHash = hashFile(source);
+	header.jsonOffset = sizeof(header);
+	header.jsonSize = text.size();
+
+	// Unique to the writer, so two runs saving the same scene at once don't write into each other
+	std::string temporary = path + "." + std::to_string(getpid()) + "."
+		+ std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()) % 100000) + ".tmp";
+	std::ofstream out(temporary, std::ios::binary);
+	if (!out.is_open()) {
+		error = "can't write " + temporary;
+		return false;
+	}
+
+	uint64_t written = 0;
+	auto pad = [&](uint64_t alignment) {
+		while (written % alignment != 0) {
+			out.put(0);
+			written++;
+		}
+	};
+
+	out.write((const char*)&header, sizeof(header)); // rewritten once the offsets are known
+	out.write(text.data(), (std::streamsize)text.size());
+	written = sizeof(header) + text.size();
+
+	std::vector<uint64_t> table;
+	for (FlatHierarchy* tree : meshes) {
+		pad(MESH_FILE_ALIGNMENT);
+		uint64_t size = writeMesh(out, *tree->mesh, tree->nodes);
+		table.push_back(written);
+		table.push_back(size);
+		written += size;
+	}
+
+	pad(sizeof(uint64_t));
+	header.meshTableOffset = written;
+	out.write((const char*)table.data(), (std::streamsize)(table.size() * sizeof(uint64_t)));
+	header.fileSize = written + table.size() * sizeof(uint64_t);
+
+	out.seekp(0);
+	out.write((const char*)&header, sizeof(header));
+	out.close();
+
+	if (!out.good()) {
+		error = "can't write " + temporary;
+		remove(temporary.c_str());
+		return false;
+	}
+#ifdef _WIN32
+	remove(path.c_str()); // rename doesn't replace a file there
+#endif
+	if (rename(temporary.c_str(), path.c_str()) != 0) {
+		error = "can't write " + path;
+		remove(temporary.c_str());
+		return false;
+	}
+	return true;
+}
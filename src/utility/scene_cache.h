@@ -0,0 +1,66 @@
+#ifndef scene_cache_h // include guard
+#define scene_cache_h
+
+#include "json.hpp"
+#include "mapped_file.h"
+#include "array_view.h"
+#include "../models/model.h"
+#include "../acceleration/acceleration.h"
+
+#include <stdint.h>	// uint64_t
+#include <string>	// std::string
+#include <vector>	// std::vector
+
+using json = nlohmann::json;
+
+
+// Bumped whenever the layout of the cache changes, older caches are then rebuilt
+const uint32_t SCENE_CACHE_VERSION = 1;
+
+
+struct SceneCacheHeader {
+	/// First bytes of a compiled scene. The json follows at [jsonOffset], then every mesh
+	/// in the layout of a .mesh file, each starting on MESH_FILE_ALIGNMENT.
+	char magic[8];			// "RTSCENE\0"
+	uint32_t version;
+	uint32_t meshVersion;	// MESH_FILE_VERSION
+	uint32_t leafSize;		// widest leaf the trees were built with, it depends on the triangle kernel
+	uint32_t meshCount;
+	uint64_t sourceHash;	// of the scene's .json
+	uint64_t jsonOffset;
+	uint64_t jsonSize;
+	uint64_t meshTableOffset;	// meshCount (offset, size) pairs
+	uint64_t fileSize;
+};
+
+
+class SceneCache {
+	/// A scene as it was after its first load, so later runs skip parsing, transforming and
+	/// building trees. It holds the scene's json without the triangles of its meshes (small
+	/// objects, materials, textures & lights are quick to create from it), and every mesh with
+	/// its transform applied, packed and with its flattened tree.
+	///
+	/// The cache is mapped, and the meshes are traced straight from it (see [loadMesh]).
+	/// It is only used while the hashes of the scene's .json and of every model it refers to
+	/// match the ones it was saved with; otherwise the scene is loaded as usual and saved again.
+public:
+	bool open(const std::string& path, const std::string& source, json& scene); // false if missing, stale or damaged
+	bool isOpen() const;
+
+	/// Points the views of [mesh] and [nodes] at the [index]-th mesh of the cache
+	bool loadMesh(size_t index, Mesh& mesh, ArrayView<FlatNode>& nodes, std::string& error) const;
+
+	/// [scene] refers to the meshes by their index in [meshes] (key "compiled"), [assets] are the
+	/// model files it was loaded from. The file is written under a name of its own next to
+	/// [path] and renamed, so a reader never sees it half written, even with several writers.
+	static bool save(const std::string& path, const std::string& source, const std::vector<std::string>& assets,
+		const json& scene, const std::vector<FlatHierarchy*>& meshes, std::string& error);
+
+private:
+	MappedFile file;
+	uint32_t meshCount = 0;
+	const uint64_t* meshTable = nullptr;
+};
+
+
+#endif scene_cache_h
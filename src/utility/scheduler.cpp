@@ -0,0 +1,195 @@
+#include "scheduler.h"
+
+#include <chrono>  // for high_resolution_clock
+
+
+// Which scheduler & worker the current thread belongs to (none for the main thread)
+static thread_local const Scheduler* currentScheduler = nullptr;
+static thread_local int currentIndex = -1;
+
+
+Scheduler::Scheduler(int threads) {
+	if (threads <= 0) {
+		threads = hardwareThreads();
+	}
+
+	for (int i = 0; i < threads; i++) {
+		workers.emplace_back(new Worker());
+	}
+	for (int i = 0; i < threads; i++) {
+		workers[i]->thread = std::thread(&Scheduler::workerLoop, this, i);
+	}
+}
+
+
+Scheduler::~Scheduler() {
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		stopping = true;
+	}
+	workAvailable.notify_all();
+
+	for (auto& worker : workers) {
+		worker->thread.join();
+	}
+}
+
+
+int Scheduler::size() const {
+	return (int)workers.size();
+}
+
+
+int Scheduler::hardwareThreads() {
+	int threads = (int)std::thread::hardware_concurrency();
+	return threads > 0 ? threads : 1;
+}
+
+
+int Scheduler::currentWorker() const {
+	return currentScheduler == this ? currentIndex : -1;
+}
+
+
+void Scheduler::spawn(TaskGroup& group, std::function<void()> task) {
+	group.pending++;
+
+	int index = currentWorker();
+	if (index < 0) { // spawned from outside the pool
+		index = nextWorker++ % workers.size();
+	}
+
+	Task entry;
+	entry.run = std::move(task);
+	entry.group = &group;
+	{
+		std::lock_guard<std::mutex> lock(workers[index]->mutex);
+		workers[index]->tasks.push_back(std::move(entry));
+	}
+	queued++;
+
+	{	// lock so a worker can't miss the wake up between checking [queued] and sleeping
+		std::lock_guard<std::mutex> lock(sleepMutex);
+	}
+	workAvailable.notify_one();
+}
+
+
+bool Scheduler::findTask(int index, Task& task) {
+	if (queued == 0) {
+		return false;
+	}
+
+	// Own tasks first, newest one (LIFO)
+	if (index >= 0) {
+		Worker& own = *workers[index];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (!own.tasks.empty()) {
+			task = std::move(own.tasks.back());
+			own.tasks.pop_back();
+			queued--;
+			return true;
+		}
+	}
+
+	// Otherwise steal the oldest task of someone else (FIFO)
+	int n = (int)workers.size();
+	int start = index >= 0 ? index + 1 : 0;
+	for (int i = 0; i < n; i++) {
+		int victim = (start + i) % n;
+		if (victim == index) {
+			continue;
+		}
+		Worker& other = *workers[victim];
+		std::lock_guard<std::mutex> lock(other.mutex);
+		if (!other.tasks.empty()) {
+			task = std::move(other.tasks.front());
+			other.tasks.pop_front();
+			queued--;
+			if (index >= 0) {
+				workers[index]->steals++;
+			}
+			return true;
+		}
+	}
+	return false;
+}
+
+
+void Scheduler::execute(int index, Task& task) {
+	auto start = std::chrono::high_resolution_clock::now();
+	task.run();
+	auto finish = std::chrono::high_resolution_clock::now();
+
+	if (index >= 0) {
+		workers[index]->tasksRun++;
+		workers[index]->busyNanoseconds +=
+			std::chrono::duration_cast<std::chrono::nanoseconds>(finish - start).count();
+	}
+
+	if (--task.group->pending == 0) {
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		groupDone.notify_all();
+	}
+}
+
+
+void Scheduler::workerLoop(int index) {
+	currentScheduler = this;
+	currentIndex = index;
+
+	while (true) {
+		Task task;
+		if (findTask(index, task)) {
+			execute(index, task);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		workAvailable.wait(lock, [this] { return stopping || queued > 0; });
+		if (stopping && queued == 0) {
+			return;
+		}
+	}
+}
+
+
+void Scheduler::wait(TaskGroup& group) {
+	int index = currentWorker();
+
+	if (index >= 0) { // help out instead of blocking a worker
+		while (group.pending > 0) {
+			Task task;
+			if (findTask(index, task)) {
+				execute(index, task);
+			}
+			else {
+				std::this_thread::yield();
+			}
+		}
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(sleepMutex);
+	groupDone.wait(lock, [&group] { return group.pending == 0; });
+}
+
+
+std::vector<Scheduler::WorkerStats> Scheduler::stats() const {
+	std::vector<WorkerStats> result(workers.size());
+	for (size_t i = 0; i < workers.size(); i++) {
+		result[i].tasks = workers[i]->tasksRun;
+		result[i].steals = workers[i]->steals;
+		result[i].busySeconds = workers[i]->busyNanoseconds / 1e9;
+	}
+	return result;
+}
+
+
+void Scheduler::resetStats() {
+	for (auto& worker : workers) {
+		worker->tasksRun = 0;
+		worker->steals = 0;
+		worker->busyNanoseconds = 0;
+	}
+}
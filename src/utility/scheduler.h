@@ -0,0 +1,83 @@
+#ifndef scheduler_h // include guard
+#define scheduler_h
+
+#include <atomic>				// std::atomic
+#include <condition_variable>	// std::condition_variable
+#include <deque>				// std::deque
+#include <functional>			// std::function
+#include <memory>				// std::unique_ptr
+#include <mutex>				// std::mutex
+#include <thread>				// std::thread
+#include <vector>				// std::vector
+
+
+class TaskGroup {
+	/// Counts the unfinished tasks of one batch, so the caller can wait for all of them
+public:
+	std::atomic<int> pending{ 0 };
+};
+
+
+class Scheduler {
+	/// A pool of worker threads with one task deque per worker.
+	///
+	/// A worker pushes & pops its own tasks at the back of its deque (good locality for
+	/// nested tasks) and, when it runs dry, steals the oldest task from the front of
+	/// another worker's deque. Tasks spawned from outside the pool are dealt round-robin.
+	/// This keeps all cores busy even when the cost of the tasks is very uneven.
+public:
+	explicit Scheduler(int threads = 0); // 0 means one worker per hardware thread
+	~Scheduler();
+
+	int size() const;
+
+	void spawn(TaskGroup& group, std::function<void()> task);
+
+	// Blocks until every task of the [group] has finished.
+	// A worker calling this keeps running other tasks meanwhile, so tasks may spawn & wait on subtasks.
+	void wait(TaskGroup& group);
+
+	// Statistics since the last reset
+	struct WorkerStats {
+		long long tasks = 0;
+		long long steals = 0;
+		double busySeconds = 0.0;
+	};
+	std::vector<WorkerStats> stats() const;
+	void resetStats();
+
+	static int hardwareThreads();
+
+private:
+	struct Task {
+		std::function<void()> run;
+		TaskGroup* group = nullptr;
+	};
+
+	struct Worker {
+		std::mutex mutex;
+		std::deque<Task> tasks;
+		std::thread thread;
+
+		std::atomic<long long> tasksRun{ 0 };
+		std::atomic<long long> steals{ 0 };
+		std::atomic<long long> busyNanoseconds{ 0 };
+	};
+
+	std::vector<std::unique_ptr<Worker>> workers;
+	std::atomic<int> queued{ 0 };
+	std::atomic<unsigned> nextWorker{ 0 };
+	bool stopping = false;
+
+	std::mutex sleepMutex;
+	std::condition_variable workAvailable;
+	std::condition_variable groupDone;
+
+	int currentWorker() const;
+	bool findTask(int index, Task& task);
+	void execute(int index, Task& task);
+	void workerLoop(int index);
+};
+
+
+#endif scheduler_h
@@ -28,7 +28,8 @@ glm::vec3 Texture::getPixel(float u, float v) {
 			return glm::vec3(0.4, 0.4, 0.4);
 		}
 	}
-	
+
+	return glm::vec3(0, 0, 0);
 }
 
 void Texture::loadBMP(const char* location) {
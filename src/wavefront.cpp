@@ -0,0 +1,153 @@
+#include "wavefront.h"
+
+#include <algorithm>	// std::sort, std::stable_sort
+
+
+int Wavefront::add(const Ray& ray, const Hit& closestHit) {
+	Item item;
+	item.ray = ray;
+	item.hit = closestHit;
+	item.node = (uint32_t)nodes.size();
+	item.throughput = glm::vec3(1.0f);
+	wave.push_back(item);
+
+	nodes.push_back(Node());
+	paths.push_back(item.node);
+	return (int)paths.size() - 1;
+}
+
+
+void Wavefront::run() {
+	while (!wave.empty()) {
+		shadeWave();
+		traceQueue();
+	}
+
+	// Each path adds up its hits depth first, the first bounce before the second: the order in
+	// which [shade] pops them, so the sums are the same
+	std::vector<uint32_t> stack;
+	for (uint32_t path : paths) {
+		glm::vec3 colour(0, 0, 0);
+		stack.push_back(path);
+		while (!stack.empty()) {
+			const Node& node = nodes[stack.back()];
+			stack.pop_back();
+			colour += node.colour;
+			for (int b = node.count; b-- > 0;) {
+				stack.push_back(node.first + b);
+			}
+		}
+		nodes[path].colour = colour;
+	}
+}
+
+
+glm::vec3 Wavefront::colour(int path) const {
+	return nodes[paths[path]].colour;
+}
+
+
+void Wavefront::clear() {
+	nodes.clear();
+	paths.clear();
+	wave.clear();
+	queue.clear();
+}
+
+
+void Wavefront::shadeWave() {
+	// Hits on the same material read the same data, misses (nullptr) come first
+	order.resize(wave.size());
+	for (uint32_t i = 0; i < order.size(); i++) {
+		order[i] = i;
+	}
+	std::stable_sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+		const Object* objectA = wave[a].hit.object;
+		const Object* objectB = wave[b].hit.object;
+		const Material* materialA = objectA ? objectA->material : nullptr;
+		const Material* materialB = objectB ? objectB->material : nullptr;
+		return materialA < materialB;
+	});
+
+	queue.clear();
+	long long traced = 0;
+	long long cut = 0;
+	for (uint32_t i : order) {
+		Item& item = wave[i];
+		if (item.ownRandom) {
+			item.ray.random = &item.random; // the item may have moved since it was queued
+		}
+
+		Bounce bounces[MAX_BOUNCES];
+		int count = 0;
+		glm::vec3 colour = shadeHit(item.ray, item.hit, bounces, count);
+
+		uint32_t first = (uint32_t)nodes.size();
+		Node& node = nodes[item.node];
+		node.colour = item.throughput * colour;
+		node.first = first;
+		node.count = count;
+
+		int kept = 0;
+		for (int b = 0; b < count; b++) {
+			bounces[b].weight = item.throughput * bounces[b].weight;
+			if (!keepBounce(bounces[b])) {
+				cut += bounces[b].passing ? 0 : 1;
+				continue;
+			}
+			traced += bounces[b].passing ? 0 : 1;
+
+			Item next;
+			next.throughput = bounces[b].weight;
+			next.ray = bounces[b].ray;
+			next.random = bounces[b].random;
+			next.ownRandom = true;
+			next.node = first + kept++;
+			queue.push_back(next);
+		}
+		node.count = kept;
+		nodes.resize(nodes.size() + kept);
+	}
+	wave.clear();
+	pathStats.add(traced, cut);
+}
+
+
+// Spreads the 10 low bits of [v] 3 bits apart
+static uint32_t spreadBits(uint32_t v) {
+	v = (v | (v << 16)) & 0x030000FF;
+	v = (v | (v << 8)) & 0x0300F00F;
+	v = (v | (v << 4)) & 0x030C30C3;
+	v = (v | (v << 2)) & 0x09249249;
+	return v;
+}
+
+
+void Wavefront::traceQueue() {
+	// Sorted by direction octant, then along a Morton curve through the scene box by origin
+	glm::vec3 min = glm::vec3(0.0f);
+	glm::vec3 size = glm::vec3(1.0f);
+	if (!scene->topLevel.nodes.empty()) {
+		min = scene->topLevel.nodes[0].min;
+		size = glm::max(scene->topLevel.nodes[0].max - min, glm::vec3(FLT_MIN));
+	}
+
+	std::vector<uint64_t> keys(queue.size());
+	for (uint32_t i = 0; i < queue.size(); i++) {
+		const Ray& ray = queue[i].ray;
+		glm::vec3 cell = glm::clamp((ray.origin - min) / size, 0.0f, 1.0f) * 1023.0f;
+		uint32_t morton = spreadBits((uint32_t)cell.x) | (spreadBits((uint32_t)cell.y) << 1) | (spreadBits((uint32_t)cell.z) << 2);
+		uint32_t octant = ray.sign[0] | (ray.sign[1] << 1) | (ray.sign[2] << 2);
+		keys[i] = ((uint64_t)octant << 61) | ((uint64_t)morton << 31) | i; // unique, so the order is fixed
+	}
+	std::sort(keys.begin(), keys.end());
+
+	wave.reserve(queue.size());
+	for (uint64_t key : keys) {
+		Item& item = queue[(uint32_t)(key & 0x7FFFFFFF)];
+		item.hit = Hit();
+		scene->topLevel.isHit(item.ray, item.hit);
+		wave.push_back(item);
+	}
+	queue.clear();
+}
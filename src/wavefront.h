@@ -0,0 +1,64 @@
+#ifndef wavefront_h // include guard
+#define wavefront_h
+
+#include "raytracer.h"
+#include "utility/random.h"
+
+#include <glm/glm.hpp>  // glm
+#include <stdint.h>		// uint32_t
+#include <vector>		// std::vector
+
+
+class Wavefront {
+	/// Breadth first version of [trace], for a set of paths at once (e.g. the pixels of a tile).
+	///
+	/// [trace] follows each reflection & refraction right away, so the secondary rays of
+	/// neighbouring pixels are never traced next to each other. Here every hit is shaded with
+	/// [shadeHit], and the rays it spawns are queued instead. Each wave of queued rays is sorted
+	/// by direction octant and by origin, so rays going the same way through the same part of
+	/// the scene are traced one after the other, while the nodes they visit are still cached.
+	/// The hits are then shaded grouped by material.
+	///
+	/// Every hit keeps its colour times its throughput, and the colours of a path are summed at the
+	/// end in the same order as [shade], so the image is exactly the one [trace] gives.
+public:
+	// Adds the path of a primary [ray] which found [closestHit], returns its index for [colour]
+	int add(const Ray& ray, const Hit& closestHit);
+
+	// Traces all the paths, then [colour] can be read
+	void run();
+
+	glm::vec3 colour(int path) const;
+
+	void clear();
+
+private:
+	class Node {
+	public:
+		glm::vec3 colour;	// of the hit alone times its throughput, for a path the total once [run] is done
+		uint32_t first = 0;	// bounces are the nodes [first, first + count)
+		int count = 0;
+	};
+
+	class Item {
+	public:
+		Ray ray;
+		Hit hit;
+		uint32_t node;
+		glm::vec3 throughput; // product of the weights from the primary ray
+		Random random;
+		bool ownRandom = false; // false for primary rays, which use the pixel's
+	};
+
+	std::vector<Node> nodes;
+	std::vector<uint32_t> paths;	// node of each primary ray
+	std::vector<Item> wave;			// hits to shade
+	std::vector<Item> queue;		// rays to trace
+	std::vector<uint32_t> order;
+
+	void shadeWave();
+	void traceQueue();
+};
+
+
+#endif wavefront_h
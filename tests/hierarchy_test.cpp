@@ -0,0 +1,213 @@
+// Checks of the trees over meshes (acceleration/): their shape, and that they find the same hits
+// as testing every triangle
+
+#include "test.h"
+
+#include <algorithm>	// std::count
+#include <cmath>		// sin, fmod
+#include <random>	// std::mt19937
+#include <string.h>	// memcmp
+
+#include "acceleration/acceleration.h"
+
+
+static void build(FlatHierarchy& tree, Mesh& mesh, HierarchyType type, int threads) {
+	Scheduler scheduler(threads);
+	MeshHierarchy hierarchy = MeshHierarchy();
+	hierarchy.build(&mesh, type, &scheduler);
+	tree.flatten(&hierarchy);
+}
+
+
+static bool contains(const FlatNode& node, glm::vec3 point) {
+	return glm::all(glm::lessThanEqual(node.min, point)) && glm::all(glm::lessThanEqual(point, node.max));
+}
+
+
+// Children come after their parent, every box holds what is below it, and the leaves
+// reached from the root hold every triangle exactly once
+static bool isValid(const FlatHierarchy& tree) {
+	const Mesh& mesh = *tree.mesh;
+	std::vector<int> seen(mesh.triangleCount(), 0);
+	std::vector<uint32_t> pending = { 0 };
+	while (!pending.empty()) {
+		uint32_t i = pending.back();
+		pending.pop_back();
+		const FlatNode& node = tree.nodes[i];
+		for (uint32_t c = node.first; c < node.first + node.count; c++) {
+			if (node.isLeaf) {
+				if (c >= seen.size()) {
+					return false;
+				}
+				seen[c]++;
+				for (int k = 0; k < 3; k++) {
+					if (!contains(node, mesh.packed(c, k))) {
+						return false;
+					}
+				}
+			}
+			else {
+				if (c <= i || c >= tree.nodes.size
+					|| !contains(node, tree.nodes[c].min) || !contains(node, tree.nodes[c].max)) {
+					return false;
+				}
+				pending.push_back(c);
+			}
+		}
+	}
+	return std::count(seen.begin(), seen.end(), 1) == (int)seen.size();
+}
+
+
+// Rays from all around the mesh at random points of its box: true if [tree] hits the same as
+// testing every triangle of its mesh, and sets [hits] to how many rays hit something
+static bool sameHits(FlatHierarchy& tree, int& hits) {
+	const Mesh& mesh = *tree.mesh;
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	glm::vec3 center = (mesh.min + mesh.max) / 2.0f;
+	float radius = glm::length(mesh.max - mesh.min);
+
+	hits = 0;
+	for (int i = 0; i < 2000; i++) {
+		glm::vec3 target = mesh.min + (mesh.max - mesh.min) * glm::vec3(unit(random), unit(random), unit(random));
+		glm::vec3 from = glm::normalize(glm::vec3(unit(random) - 0.5f, unit(random) - 0.5f, unit(random) - 0.5f));
+		Ray ray;
+		ray.origin = center + radius * from;
+		ray.setDirection(glm::normalize(target - ray.origin));
+		ray.maxLen = 2.0f * radius;
+
+		Hit expected = Hit(), found = Hit();
+		bool isExpected = mesh.isHit(ray, 0, mesh.triangleCount(), expected);
+		bool isFound = tree.isHit(ray, found);
+		if (isExpected != isFound || (isFound && expected.rayLen != found.rayLen)) {
+			return false;
+		}
+		hits += isFound;
+	}
+	return true;
+}
+
+
+TEST(lbvh_tree) {
+	Mesh mesh;
+	makeGrid(mesh, 20);
+	FlatHierarchy tree;
+	build(tree, mesh, HierarchyType::lbvh, 2);
+	CHECK(isValid(tree));
+	int hits;
+	CHECK(sameHits(tree, hits));
+	CHECK(hits > 100);
+}
+
+
+TEST(lbvh_same_centroids) {
+	// every triangle in the same place, so their Morton codes are all the same
+	std::vector<glm::vec3> corners;
+	for (int i = 0; i < 300; i++) {
+		corners.insert(corners.end(), { glm::vec3(0, 0, 0), glm::vec3(1, 0, 0), glm::vec3(0, 1, 0) });
+	}
+	Mesh mesh;
+	mesh.setTriangles(corners);
+	mesh.resetOrigin();
+	mesh.pack();
+	FlatHierarchy tree;
+	build(tree, mesh, HierarchyType::lbvh, 2);
+	CHECK(isValid(tree));
+	int hits;
+	CHECK(sameHits(tree, hits));
+}
+
+
+TEST(lbvh_threads) {
+	// the same tree whatever the number of threads that built it
+	Mesh mesh1, mesh4;
+	makeGrid(mesh1, 40);
+	makeGrid(mesh4, 40);
+	FlatHierarchy tree1, tree4;
+	build(tree1, mesh1, HierarchyType::lbvh, 1);
+	build(tree4, mesh4, HierarchyType::lbvh, 4);
+	CHECK(tree1.nodes.size == tree4.nodes.size
+		&& memcmp(tree1.nodes.data, tree4.nodes.data, tree1.nodes.size * sizeof(FlatNode)) == 0);
+	CHECK(mesh1.indices == mesh4.indices);
+}
+
+
+TEST(lbvh_cost) {
+	// treelet optimization should keep it close to the SAH build
+	Mesh lbvhMesh, sahMesh;
+	makeGrid(lbvhMesh, 40);
+	makeGrid(sahMesh, 40);
+	FlatHierarchy lbvh, sah;
+	build(lbvh, lbvhMesh, HierarchyType::lbvh, 2);
+	build(sah, sahMesh, HierarchyType::sah, 2);
+	CHECK(lbvh.cost() < 1.5f * sah.cost());
+}
+
+
+// Moves the vertices of a [makeGrid] mesh up & down in a wave, [phase] 0 leaves them in place
+static void wave(Mesh& mesh, const std::vector<glm::vec3>& rest, float phase) {
+	for (size_t i = 0; i < rest.size(); i++) {
+		glm::vec3 point = rest[i];
+		mesh.vertices[i] = point + glm::vec3(0.0f, 0.0f, phase * std::sin(0.5f * point.x + phase));
+	}
+}
+
+
+TEST(refit_same_as_build) {
+	Mesh mesh;
+	makeGrid(mesh, 24);
+	FlatHierarchy tree;
+	tree.type = HierarchyType::sah;
+	build(tree, mesh, tree.type, 2);
+	std::vector<glm::vec3> rest = mesh.vertices;
+	std::vector<FlatNode> built = tree.nodeStorage;
+
+	// boxes tight around the moved triangles, the same hits as a new tree
+	Scheduler scheduler(2);
+	wave(mesh, rest, 1.5f);
+	CHECK(!tree.update(&scheduler, 1000.0f));
+	CHECK(isValid(tree));
+	int hits;
+	CHECK(sameHits(tree, hits));
+	CHECK(hits > 100);
+
+	Mesh freshMesh = mesh;
+	freshMesh.pack();
+	FlatHierarchy fresh;
+	build(fresh, freshMesh, tree.type, 2);
+	CHECK(tree.nodes[0].min == fresh.nodes[0].min && tree.nodes[0].max == fresh.nodes[0].max);
+	CHECK(mesh.min == fresh.nodes[0].min && mesh.max == fresh.nodes[0].max); // reset by [update]
+
+	// back where it was built, the refitted tree is the built one (compared by value, a
+	// coordinate of -0 may come back as 0)
+	wave(mesh, rest, 0.0f);
+	CHECK(!tree.update(&scheduler, 1000.0f));
+	bool same = tree.nodeStorage.size() == built.size();
+	for (size_t i = 0; same && i < built.size(); i++) {
+		const FlatNode& node = tree.nodeStorage[i];
+		same = node.min == built[i].min && node.max == built[i].max && node.first == built[i].first
+			&& node.count == built[i].count && node.isLeaf == built[i].isLeaf;
+	}
+	CHECK(same);
+}
+
+
+TEST(refit_rebuilds) {
+	Mesh mesh;
+	makeGrid(mesh, 24);
+	FlatHierarchy tree;
+	tree.type = HierarchyType::sah;
+	build(tree, mesh, tree.type, 1);
+	float builtCost = tree.builtCost;
+
+	// scrambled far from where the tree was built, refitting would cost too much
+	for (glm::vec3& point : mesh.vertices) {
+		point = glm::vec3(point.y, std::fmod(point.x * 7.0f, 24.0f), point.z);
+	}
+	CHECK(tree.update(nullptr, 1.1f));
+	CHECK(tree.builtCost != builtCost && tree.cost() == tree.builtCost);
+	CHECK(isValid(tree));
+	int hits;
+	CHECK(sameHits(tree, hits));
+}
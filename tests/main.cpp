@@ -0,0 +1,48 @@
+// Runs every test linked in (see TEST in test.h), e.g. "make test" from the src folder.
+// Prints one line per test and exits with a failure if any check failed.
+
+#include "test.h"
+
+#include <cstdio>	// fdopen, fwrite
+#include <cstdlib>	// EXIT_SUCCESS, mkstemps
+#include <cstring>	// strlen
+#include <iostream>	// std::cout
+
+
+static bool failed;
+
+std::vector<Test>& Test::all() {
+	static std::vector<Test> tests;
+	return tests;
+}
+
+void Test::fail(const char* file, int line, const char* condition) {
+	std::cout << "\n    " << file << ":" << line << ": CHECK(" << condition << ") failed";
+	failed = true;
+}
+
+std::string temporaryFile(const std::string& contents, const char* suffix) {
+	std::string path = std::string("/tmp/raytracer_test_XXXXXX") + suffix;
+	int fd = mkstemps(&path[0], (int)strlen(suffix));
+	if (fd < 0) {
+		return "";
+	}
+	FILE* file = fdopen(fd, "wb");
+	fwrite(contents.data(), 1, contents.size(), file);
+	fclose(file);
+	return path;
+}
+
+
+int main() {
+	int failures = 0;
+	for (const Test& test : Test::all()) {
+		std::cout << test.name << "..." << std::flush;
+		failed = false;
+		test.run();
+		std::cout << (failed ? "\n  FAILED" : " ok") << std::endl;
+		failures += failed;
+	}
+	std::cout << Test::all().size() - failures << "/" << Test::all().size() << " tests passed" << std::endl;
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,135 @@
+// Checks of utility/mesh_file: a written mesh loads back as it was, damaged ones are rejected
+
+#include "test.h"
+
+#include <sstream>	// std::ostringstream
+#include <string.h>	// memcpy
+
+#include "acceleration/acceleration.h"
+#include "utility/mesh_file.h"
+
+
+// A mesh file in memory, kept 8 byte aligned like a mapping would be (more than enough for floats)
+struct MeshBytes {
+	std::vector<uint64_t> words;
+	uint64_t size = 0;
+
+	explicit MeshBytes(const std::string& bytes) : words((bytes.size() + 7) / 8), size(bytes.size()) {
+		memcpy(words.data(), bytes.data(), bytes.size());
+	}
+	char* data() { return (char*)words.data(); }
+	MeshFileHeader header() { MeshFileHeader header; memcpy(&header, data(), sizeof(header)); return header; }
+	FlatNode& node(uint32_t i) { return ((FlatNode*)(data() + header().nodeOffset))[i]; }
+	uint32_t& index(uint32_t i) { return ((uint32_t*)(data() + header().indexOffset))[i]; }
+
+	bool load(std::string& error) {
+		Mesh mesh;
+		ArrayView<FlatNode> nodes;
+		return loadMesh(data(), size, mesh, nodes, error);
+	}
+};
+
+
+static std::string write(const Mesh& mesh, ArrayView<FlatNode> nodes) {
+	std::ostringstream out;
+	writeMesh(out, mesh, nodes);
+	return out.str();
+}
+
+
+TEST(mesh_file_round_trip) {
+	Mesh mesh;
+	makeGrid(mesh, 12);
+	Scheduler scheduler;
+	MeshHierarchy hierarchy = MeshHierarchy();
+	hierarchy.build(&mesh, HierarchyType::sah, &scheduler);
+	FlatHierarchy tree;
+	tree.flatten(&hierarchy);
+
+	MeshBytes bytes(write(*tree.mesh, tree.nodes));
+	Mesh loaded;
+	ArrayView<FlatNode> nodes;
+	std::string error;
+	CHECK(loadMesh(bytes.data(), bytes.size, loaded, nodes, error));
+	CHECK(loaded.triangleCount() == tree.mesh->triangleCount() && nodes.size == tree.nodes.size);
+	CHECK(loaded.min == tree.mesh->min && loaded.max == tree.mesh->max);
+	bool same = true;
+	for (uint32_t t = 0; t < loaded.triangleCount(); t++) {
+		for (int k = 0; k < 3; k++) {
+			same = same && loaded.corner(t, k) == tree.mesh->corner(t, k) && loaded.packed(t, k) == tree.mesh->packed(t, k);
+		}
+	}
+	CHECK(same);
+	CHECK(memcmp(nodes.data, tree.nodes.data, nodes.size * sizeof(FlatNode)) == 0);
+}
+
+
+TEST(mesh_file_damaged) {
+	Mesh mesh;
+	makeGrid(mesh, 12);
+	Scheduler scheduler;
+	MeshHierarchy hierarchy = MeshHierarchy();
+	hierarchy.build(&mesh, HierarchyType::sah, &scheduler);
+	FlatHierarchy tree;
+	tree.flatten(&hierarchy);
+	std::string good = write(*tree.mesh, tree.nodes);
+	std::string error;
+
+	CHECK(!MeshBytes(good.substr(0, good.size() - 1)).load(error));
+	CHECK(!MeshBytes(good.substr(0, 10)).load(error));
+
+	MeshBytes index(good);
+	index.index(5) = index.header().vertexCount;
+	CHECK(!index.load(error));
+
+	uint32_t inner = 0, leaf = 0;
+	for (uint32_t i = 0; i < tree.nodes.size; i++) {
+		(tree.nodes[i].isLeaf ? leaf : inner) = i;
+	}
+	CHECK(inner > 0);
+
+	MeshBytes child(good);
+	child.node(inner).first = (uint32_t)tree.nodes.size - 1;
+	CHECK(!child.load(error));
+	MeshBytes cycle(good);
+	cycle.node(inner).first = 0;
+	CHECK(!cycle.load(error));
+	MeshBytes children(good);
+	children.node(0).count = 0x7fffffff;
+	CHECK(!children.load(error));
+	MeshBytes primitives(good);
+	primitives.node(leaf).first = mesh.triangleCount() - primitives.node(leaf).count + 1;
+	CHECK(!primitives.load(error));
+}
+
+
+// A chain of inner nodes, each with a leaf & the next inner node as children: every level
+// leaves one sibling on the traversal stack
+static std::vector<FlatNode> chain(uint32_t depth, uint32_t triangles) {
+	std::vector<FlatNode> nodes(2 * depth + 1);
+	for (uint32_t i = 0; i < depth; i++) {
+		nodes[2 * i].first = 2 * i + 1;
+		nodes[2 * i].count = 2;
+		nodes[2 * i].isLeaf = 0;
+		nodes[2 * i + 1].first = 0;
+		nodes[2 * i + 1].count = triangles;
+		nodes[2 * i + 1].isLeaf = 1;
+	}
+	nodes[2 * depth].first = 0;
+	nodes[2 * depth].count = triangles;
+	nodes[2 * depth].isLeaf = 1;
+	return nodes;
+}
+
+
+TEST(mesh_file_depth) {
+	Mesh mesh;
+	makeGrid(mesh, 2);
+	std::string error;
+
+	std::vector<FlatNode> deep = chain(FLAT_STACK_SIZE - 1, mesh.triangleCount());
+	CHECK(MeshBytes(write(mesh, deep)).load(error));
+	std::vector<FlatNode> tooDeep = chain(FLAT_STACK_SIZE, mesh.triangleCount());
+	CHECK(!MeshBytes(write(mesh, tooDeep)).load(error));
+	CHECK(error.find("damaged") != std::string::npos);
+}
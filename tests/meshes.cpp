@@ -0,0 +1,24 @@
+// Meshes shared by the tests
+
+#include "test.h"
+
+#include <cmath>	// sin, cos
+
+#include "models/model.h"
+
+
+void makeGrid(Mesh& mesh, int size) {
+	auto point = [&](int x, int y) {
+		return glm::vec3(x, y, 0.5f * std::sin(0.7f * x) * std::cos(0.3f * y));
+	};
+	std::vector<glm::vec3> corners;
+	for (int y = 0; y < size; y++) {
+		for (int x = 0; x < size; x++) {
+			glm::vec3 quad[] = { point(x, y), point(x + 1, y), point(x + 1, y + 1), point(x, y + 1) };
+			corners.insert(corners.end(), { quad[0], quad[1], quad[2], quad[0], quad[2], quad[3] });
+		}
+	}
+	mesh.setTriangles(corners);
+	mesh.resetOrigin();
+	mesh.pack();
+}
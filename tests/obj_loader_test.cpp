@@ -0,0 +1,86 @@
+// Checks of utility/obj_loader: number parsing, fans, relative indices & rejected files
+
+#include "test.h"
+
+#include <cstdio>	// remove
+#include <cstdlib>	// strtof
+
+#include "utility/obj_loader.h"
+
+
+static bool load(const std::string& contents, std::vector<glm::vec3>& vertices, std::vector<uint32_t>& indices,
+	std::string& error, int threads = 1) {
+
+	std::string path = temporaryFile(contents, ".obj");
+	bool loaded = loadObj(path, vertices, indices, error, threads);
+	remove(path.c_str());
+	return loaded;
+}
+
+
+TEST(obj_numbers) {
+	// the last three round differently through a double than straight to a float
+	const char* numbers[] = { "0", "-1.5", "3.25e2", "1e-3", "0.1", "123456.7", "1.17549435e-38", "3.4e38",
+		"4.963480710983276", "4.595928907394409", "7.686121225357056" };
+	for (const char* number : numbers) {
+		std::vector<glm::vec3> vertices;
+		std::vector<uint32_t> indices;
+		std::string error;
+		std::string line = std::string("v ") + number + " 0 0\n";
+		CHECK(load(line + line + line + "f 1 2 3\n", vertices, indices, error));
+		CHECK(vertices.size() == 3 && vertices[0].x == strtof(number, nullptr));
+	}
+}
+
+
+TEST(obj_faces) {
+	std::vector<glm::vec3> vertices;
+	std::vector<uint32_t> indices;
+	std::string error;
+	// a quad with v/vt/vn corners becomes a fan, negative indices count back from the last vertex
+	CHECK(load("# quad\nv 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\nvt 0 0\nf 1/1/1 2/1/1 3//1 4\nf -4 -3 -1\n",
+		vertices, indices, error));
+	std::vector<uint32_t> expected = { 0, 1, 2, 0, 2, 3, 0, 1, 3 };
+	CHECK(vertices.size() == 4 && indices == expected);
+}
+
+
+TEST(obj_chunks) {
+	// the same file cut into several chunks gives the same mesh
+	std::string contents;
+	for (int i = 0; i < 3000; i++) {
+		contents += "v " + std::to_string(i) + " " + std::to_string(i % 7) + ".5 -" + std::to_string(i % 3) + "\n";
+		if (i >= 2) {
+			contents += i % 2 ? "f -3 -2 -1\n" : "f " + std::to_string(i - 1) + " " + std::to_string(i) + " 1\n";
+		}
+	}
+	std::vector<glm::vec3> vertices1, vertices4;
+	std::vector<uint32_t> indices1, indices4;
+	std::string error;
+	CHECK(load(contents, vertices1, indices1, error, 1));
+	CHECK(load(contents, vertices4, indices4, error, 4));
+	CHECK(vertices1 == vertices4 && indices1 == indices4);
+}
+
+
+TEST(obj_errors) {
+	std::vector<glm::vec3> vertices;
+	std::vector<uint32_t> indices;
+	std::string error;
+
+	CHECK(!load("", vertices, indices, error));
+	CHECK(error.find("no faces") != std::string::npos);
+	CHECK(!load("v 0 0 0\nv 1 0 0\nv 0 1 0\n", vertices, indices, error));
+	CHECK(error.find("no faces") != std::string::npos);
+
+	CHECK(!load("v 0 0 0\nv 1 x 0\n", vertices, indices, error));
+	CHECK(error.find("line 2") != std::string::npos);
+	CHECK(!load("v 0 0 0\nv 1 0 0\nf 1 2\n", vertices, indices, error));
+	CHECK(error.find("line 3") != std::string::npos);
+
+	// out of range, after a quad (2 triangles) & a comment
+	CHECK(!load("v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\nf 1 2 3 4\n# here\nf 1 2 5\n", vertices, indices, error));
+	CHECK(error.find("line 7") != std::string::npos && error.find("vertex 5 of 4") != std::string::npos);
+	CHECK(!load("v 0 0 0\nv 1 0 0\nf 1 2 -3\n", vertices, indices, error));
+	CHECK(error.find("line 3") != std::string::npos);
+}
@@ -0,0 +1,128 @@
+// Checks of utility/scene_cache: a saved scene opens again, stale & damaged ones don't
+
+#include "test.h"
+
+#include <cstdio>	// remove
+#include <fstream>	// std::ifstream, std::ofstream
+#include <iterator>	// std::istreambuf_iterator
+#include <string.h>	// memcpy
+
+#include "utility/scene_cache.h"
+
+
+static std::string readFile(const std::string& path) {
+	std::ifstream in(path, std::ios::binary);
+	return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+static void writeFile(const std::string& path, const std::string& contents) {
+	std::ofstream(path, std::ios::binary) << contents;
+}
+
+
+// A scene with one mesh, saved to a cache next to its source & model
+struct CachedScene {
+	std::string source = temporaryFile("{ \"objects\": [] }", ".json");
+	std::string model = temporaryFile("v 0 0 0", ".obj");
+	std::string path = source + ".scene";
+	json scene = { { "objects", { { { "type", "mesh" }, { "compiled", 0 } } } } };
+	Mesh mesh;
+	FlatHierarchy tree;
+	MeshHierarchy hierarchy = MeshHierarchy();
+
+	CachedScene() {
+		makeGrid(mesh, 6);
+		Scheduler scheduler;
+		hierarchy.build(&mesh, HierarchyType::sah, &scheduler);
+		tree.flatten(&hierarchy);
+	}
+	~CachedScene() {
+		remove(source.c_str());
+		remove(model.c_str());
+		remove(path.c_str());
+	}
+
+	bool save() {
+		std::string error;
+		return SceneCache::save(path, source, { model }, scene, { &tree }, error);
+	}
+	bool open() {
+		SceneCache cache;
+		json opened;
+		return cache.open(path, source, opened) && opened == scene;
+	}
+};
+
+
+TEST(scene_cache_round_trip) {
+	CachedScene cached;
+	CHECK(cached.save());
+
+	SceneCache cache;
+	json scene;
+	CHECK(cache.open(cached.path, cached.source, scene));
+	CHECK(scene == cached.scene);
+
+	Mesh mesh;
+	ArrayView<FlatNode> nodes;
+	std::string error;
+	CHECK(cache.loadMesh(0, mesh, nodes, error));
+	CHECK(!cache.loadMesh(1, mesh, nodes, error));
+	CHECK(mesh.triangleCount() == cached.tree.mesh->triangleCount() && nodes.size == cached.tree.nodes.size);
+	bool same = true;
+	for (uint32_t t = 0; t < mesh.triangleCount(); t++) {
+		for (int k = 0; k < 3; k++) {
+			same = same && mesh.packed(t, k) == cached.tree.mesh->packed(t, k);
+		}
+	}
+	CHECK(same);
+}
+
+
+TEST(scene_cache_stale) {
+	CachedScene cached;
+	CHECK(cached.save() && cached.open());
+	writeFile(cached.model, "v 0 0 1");
+	CHECK(!cached.open());
+	CHECK(cached.save() && cached.open());
+	writeFile(cached.source, "{}");
+	CHECK(!cached.open());
+}
+
+
+// Rewrites the json of the cache with [change] applied, padded with spaces to the same length
+// so the offsets in the header stay right: the json still parses, but not as a cache
+template <typename Change>
+static void damage(const std::string& path, const std::string& good, Change change) {
+	SceneCacheHeader header;
+	memcpy(&header, good.data(), sizeof(header));
+	json contents = json::parse(good.substr(header.jsonOffset, header.jsonSize));
+	change(contents);
+	std::string text = contents.dump();
+	text.resize(header.jsonSize, ' ');
+	writeFile(path, std::string(good).replace(header.jsonOffset, header.jsonSize, text));
+}
+
+
+TEST(scene_cache_damaged) {
+	CachedScene cached;
+	CHECK(cached.save());
+	std::string good = readFile(cached.path);
+
+	writeFile(cached.path, good.substr(0, good.size() - 1));
+	CHECK(!cached.open());
+	writeFile(cached.path, good.substr(0, sizeof(SceneCacheHeader) / 2));
+	CHECK(!cached.open());
+
+	damage(cached.path, good, [](json& contents) { contents["assets"][0].erase("file"); });
+	CHECK(!cached.open());
+	damage(cached.path, good, [](json& contents) { contents["assets"][0]["hash"] = "x"; });
+	CHECK(!cached.open());
+	damage(cached.path, good, [](json& contents) { contents["assets"][0] = 7; });
+	CHECK(!cached.open());
+	damage(cached.path, good, [](json& contents) { contents["scene"] = 7; });
+	CHECK(!cached.open());
+
+	damage(cached.path, good, [](json&) {});
+	CHECK(cached.open());
+}
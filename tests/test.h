@@ -0,0 +1,46 @@
+#ifndef test_h // include guard
+#define test_h
+
+#include <functional>	// std::function
+#include <string>		// std::string
+#include <vector>		// std::vector
+
+
+/// A check of one feature, registered by TEST() & run by tests/main.cpp
+struct Test {
+	const char* name;
+	std::function<void()> run;
+
+	/// Every test of the program, in the order their files were linked
+	static std::vector<Test>& all();
+	/// Marks the running test as failed & prints where
+	static void fail(const char* file, int line, const char* condition);
+
+	Test(const char* name, std::function<void()> run) : name(name), run(run) {
+		all().push_back(*this);
+	}
+};
+
+
+#define TEST_CONCAT2(a, b) a##b
+#define TEST_CONCAT(a, b) TEST_CONCAT2(a, b)
+
+// Defines & registers a test, e.g. TEST(obj_no_faces) { CHECK(...); }
+#define TEST(name) \
+	static void test_##name(); \
+	static Test TEST_CONCAT(registered_, name)(#name, test_##name); \
+	static void test_##name()
+
+// Fails the running test without stopping it, so every broken check is reported
+#define CHECK(condition) ((condition) ? (void)0 : Test::fail(__FILE__, __LINE__, #condition))
+
+
+// Writes [contents] to a new file in /tmp & returns its path, the caller removes it
+std::string temporaryFile(const std::string& contents, const char* suffix = "");
+
+class Mesh;
+// A bumpy [size] x [size] grid of quads, 2 triangles each, packed & ready to build a tree over
+void makeGrid(Mesh& mesh, int size);
+
+
+#endif test_h
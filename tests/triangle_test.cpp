@@ -0,0 +1,62 @@
+// Checks of the triangle kernels (models/triangle_simd.cpp): every one the CPU can run finds
+// the same hits as the scalar loop, on any range of triangles
+
+#include "test.h"
+
+#include <algorithm>	// std::min
+#include <cstdio>		// printf
+#include <random>	// std::mt19937
+
+#include "models/model.h"
+
+
+TEST(triangle_kernels) {
+	Mesh mesh;
+	makeGrid(mesh, 5);
+	std::mt19937 random(3);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+	// Rays through vertices & edge midpoints, the points shared by several triangles,
+	// where ties between lanes are decided
+	std::vector<glm::vec3> targets;
+	for (uint32_t t = 0; t < mesh.triangleCount(); t++) {
+		for (int k = 0; k < 3; k++) {
+			targets.push_back(mesh.corner(t, k));
+			targets.push_back((mesh.corner(t, k) + mesh.corner(t, (k + 1) % 3)) / 2.0f);
+		}
+	}
+
+	TriangleKernel previous = triangleKernel();
+	TriangleKernel kernels[] = { TriangleKernel::scalar, TriangleKernel::sse4, TriangleKernel::avx2 };
+	for (TriangleKernel kernel : kernels) {
+		if (!setTriangleKernel(kernel)) {
+			continue; // not on this CPU
+		}
+		bool same = true;
+		size_t hits = 0;
+		for (glm::vec3 target : targets) {
+			Ray ray;
+			ray.origin = target + glm::vec3(unit(random), unit(random), 3.0f);
+			ray.setDirection(glm::normalize(target - ray.origin));
+
+			// the whole mesh, and a range up to a few passes long, so the lanes past its end are masked
+			uint32_t first = (uint32_t)(random() % mesh.triangleCount());
+			uint32_t end = std::min(mesh.triangleCount(), first + 1 + (uint32_t)(random() % 20));
+			uint32_t ranges[2][2] = { { 0, mesh.triangleCount() }, { first, end } };
+			for (auto range : ranges) {
+				Hit expected = Hit(), found = Hit();
+				bool isExpected = mesh.isHitScalar(ray, range[0], range[1], expected);
+				bool isFound = mesh.isHit(ray, range[0], range[1], found);
+				same = same && isExpected == isFound
+					&& (!isFound || (expected.rayLen == found.rayLen && expected.primitive == found.primitive));
+				hits += isFound;
+			}
+		}
+		CHECK(same);
+		CHECK(hits > targets.size());
+		if (!same) {
+			printf("\n    with the %s kernel", triangleKernelName(kernel));
+		}
+	}
+	setTriangleKernel(previous);
+}